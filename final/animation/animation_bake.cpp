@@ -0,0 +1,38 @@
+#include "animation_bake.h"
+
+#include <cfloat>
+#include <cmath>
+
+void bakeAnimationClip(const AnimationClip &clip, Skeleton skeleton, const std::vector<NodePose> &restPose,
+					   const std::vector<glm::mat4> &inverseBindMatrices, float sampleRate, BakedClip &baked)
+{
+	baked.sampleRate = sampleRate;
+	baked.duration = clip.duration;
+	baked.frameCount = int(std::ceil(clip.duration * sampleRate)) + 1;
+	baked.jointCount = int(inverseBindMatrices.size());
+	baked.texels.resize(size_t(baked.frameCount) * jointPaletteRows * baked.jointCount);
+	baked.boundsMin = glm::vec3(FLT_MAX);
+	baked.boundsMax = glm::vec3(-FLT_MAX);
+
+	std::vector<NodePose> pose;
+	AnimationCursor cursor;
+	cursor.reset(clip);
+	for (int f = 0; f < baked.frameCount; ++f) {
+		// Frames are 1 / sampleRate apart except the last, which is the clip's end and may come
+		// sooner. Sampling at exactly the duration would wrap back to the start, so it stops just short.
+		float time = f + 1 < baked.frameCount ? f / sampleRate : clip.duration * 0.99999f;
+		pose = restPose;
+		sampleAnimationClip(clip, time, cursor, pose);
+		skeleton.evaluate(pose);
+
+		glm::vec4 *row = &baked.texels[size_t(f) * jointPaletteRows * baked.jointCount];
+		for (int j = 0; j < baked.jointCount; ++j) {
+			const glm::mat4 &jointTransform = skeleton.jointTransform(j);
+			storeJointRows(jointTransform * inverseBindMatrices[j], row + jointPaletteRows * j);
+
+			glm::vec3 joint(jointTransform[3]);
+			baked.boundsMin = glm::min(baked.boundsMin, joint);
+			baked.boundsMax = glm::max(baked.boundsMax, joint);
+		}
+	}
+}
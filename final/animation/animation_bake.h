@@ -0,0 +1,31 @@
+#ifndef _ANIMATION_BAKE_H_
+#define _ANIMATION_BAKE_H_
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "animation_clip.h"
+#include "skeleton.h"
+
+// A clip sampled at a fixed rate into skinning matrices, for playback on the GPU.
+// Row f holds frame f; each joint takes three texels, the rows of its 3x4 affine
+// joint matrix. Frame f is at f / sampleRate, except the last, which is the clip's
+// end, so lookups can always blend frame f with f + 1; only the final interval can
+// be shorter than the others.
+struct BakedClip {
+	float sampleRate;
+	float duration;
+	int frameCount;
+	int jointCount;
+	std::vector<glm::vec4> texels;		// frameCount rows of 3 * jointCount
+
+	// Joint positions over every frame, in model space
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
+};
+
+void bakeAnimationClip(const AnimationClip &clip, Skeleton skeleton, const std::vector<NodePose> &restPose,
+					   const std::vector<glm::mat4> &inverseBindMatrices, float sampleRate, BakedClip &baked);
+
+#endif
@@ -0,0 +1,131 @@
+#include "animation_clip.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+static int componentCount(AnimationPath path)
+{
+	return path == ANIMATION_PATH_ROTATION ? 4 : 3;
+}
+
+void AnimationClip::addChannel(int node, AnimationPath path, AnimationInterpolation interpolation,
+							   const float *keyTimes, int keyCount, const float *keyValues)
+{
+	AnimationChannel channel;
+	channel.node = node;
+	channel.path = path;
+	channel.interpolation = interpolation;
+	channel.firstKey = int(times.size());
+	channel.keyCount = keyCount;
+	channel.firstValue = int(values.size());
+	channels.push_back(channel);
+
+	int valuesPerKey = componentCount(path) * (interpolation == ANIMATION_INTERPOLATION_CUBICSPLINE ? 3 : 1);
+	times.insert(times.end(), keyTimes, keyTimes + keyCount);
+	values.insert(values.end(), keyValues, keyValues + keyCount * valuesPerKey);
+	if (keyCount > 0) {
+		duration = std::max(duration, keyTimes[keyCount - 1]);
+	}
+}
+
+glm::mat4 NodePose::matrix() const
+{
+	glm::mat4 transform = glm::translate(glm::mat4(1.0f), translation) * glm::mat4_cast(rotation);
+	return glm::scale(transform, scale);
+}
+
+void AnimationCursor::reset(const AnimationClip &clip)
+{
+	keys.assign(clip.channels.size(), 0);
+}
+
+namespace {
+	// Key i of a channel as a vec4, slot selects in-tangent/value/out-tangent for cubic splines
+	inline glm::vec4 keyValue(const AnimationClip &clip, const AnimationChannel &channel, int components, int i, int slot)
+	{
+		int stride = channel.interpolation == ANIMATION_INTERPOLATION_CUBICSPLINE ? 3 : 1;
+		const float *v = &clip.values[channel.firstValue + (i * stride + slot) * components];
+		return glm::vec4(v[0], v[1], v[2], components == 4 ? v[3] : 0.0f);
+	}
+
+	inline glm::quat toQuat(const glm::vec4 &v)
+	{
+		return glm::quat(v.w, v.x, v.y, v.z);
+	}
+
+	// Key at or before t, starting from the cursor's last key
+	inline int seekKey(const float *times, int count, float t, int key)
+	{
+		if (key >= count || times[key] > t) {
+			// Looped or jumped back, search from the start
+			key = int(std::upper_bound(times, times + count, t) - times) - 1;
+			return std::max(key, 0);
+		}
+		while (key + 1 < count && times[key + 1] <= t) {
+			key++;
+		}
+		return key;
+	}
+}
+
+void sampleAnimationClip(const AnimationClip &clip, float time, AnimationCursor &cursor, std::vector<NodePose> &poses)
+{
+	if (cursor.keys.size() != clip.channels.size()) {
+		cursor.reset(clip);
+	}
+	float t = clip.duration > 0.0f ? std::fmod(time, clip.duration) : 0.0f;
+	if (t < 0.0f) {
+		t += clip.duration;
+	}
+
+	for (size_t c = 0; c < clip.channels.size(); ++c) {
+		const AnimationChannel &channel = clip.channels[c];
+		if (channel.keyCount == 0 || channel.node < 0 || channel.node >= int(poses.size())) {
+			continue;
+		}
+		const float *times = &clip.times[channel.firstKey];
+		int components = componentCount(channel.path);
+
+		int key = seekKey(times, channel.keyCount, t, cursor.keys[c]);
+		cursor.keys[c] = key;
+
+		// Clamp before the first and after the last key
+		glm::vec4 value;
+		bool cubic = channel.interpolation == ANIMATION_INTERPOLATION_CUBICSPLINE;
+		int valueSlot = cubic ? 1 : 0;
+		if (key + 1 >= channel.keyCount || t <= times[key] || channel.interpolation == ANIMATION_INTERPOLATION_STEP) {
+			value = keyValue(clip, channel, components, key, valueSlot);
+		} else {
+			float dt = times[key + 1] - times[key];
+			float s = (t - times[key]) / dt;
+			if (cubic) {
+				float s2 = s * s, s3 = s2 * s;
+				value = (2.0f * s3 - 3.0f * s2 + 1.0f) * keyValue(clip, channel, components, key, 1)
+					  + (s3 - 2.0f * s2 + s) * dt * keyValue(clip, channel, components, key, 2)
+					  + (-2.0f * s3 + 3.0f * s2) * keyValue(clip, channel, components, key + 1, 1)
+					  + (s3 - s2) * dt * keyValue(clip, channel, components, key + 1, 0);
+			} else if (channel.path == ANIMATION_PATH_ROTATION) {
+				glm::quat q = glm::slerp(toQuat(keyValue(clip, channel, components, key, 0)),
+										 toQuat(keyValue(clip, channel, components, key + 1, 0)), s);
+				value = glm::vec4(q.x, q.y, q.z, q.w);
+			} else {
+				value = glm::mix(keyValue(clip, channel, components, key, 0), keyValue(clip, channel, components, key + 1, 0), s);
+			}
+		}
+
+		NodePose &pose = poses[channel.node];
+		switch (channel.path) {
+		case ANIMATION_PATH_TRANSLATION:
+			pose.translation = glm::vec3(value);
+			break;
+		case ANIMATION_PATH_ROTATION:
+			pose.rotation = glm::normalize(toQuat(value));
+			break;
+		case ANIMATION_PATH_SCALE:
+			pose.scale = glm::vec3(value);
+			break;
+		}
+	}
+}
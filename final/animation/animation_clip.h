@@ -0,0 +1,69 @@
+#ifndef _ANIMATION_CLIP_H_
+#define _ANIMATION_CLIP_H_
+
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+#include <vector>
+
+enum AnimationPath {
+	ANIMATION_PATH_TRANSLATION,
+	ANIMATION_PATH_ROTATION,
+	ANIMATION_PATH_SCALE
+};
+
+enum AnimationInterpolation {
+	ANIMATION_INTERPOLATION_LINEAR,		// Slerp for rotations
+	ANIMATION_INTERPOLATION_STEP,
+	ANIMATION_INTERPOLATION_CUBICSPLINE	// Hermite, keys hold in-tangent, value, out-tangent
+};
+
+// One animated property of one node. Its keys live in the clip's shared arrays.
+struct AnimationChannel {
+	int node;
+	AnimationPath path;
+	AnimationInterpolation interpolation;
+	int firstKey;		// Index of the first key time in AnimationClip::times
+	int keyCount;
+	int firstValue;		// Index of the first float in AnimationClip::values
+};
+
+// Animation compiled for playback: channels resolved to nodes and enums, all key
+// times in one array and all key values in another, so sampling never touches
+// the source asset. Rotations are stored x, y, z, w as in glTF.
+struct AnimationClip {
+	float duration;
+	std::vector<AnimationChannel> channels;
+	std::vector<float> times;
+	std::vector<float> values;
+
+	AnimationClip() : duration(0.0f) {}
+
+	// Appends a channel, values holds keyCount keys (three per key for cubic splines)
+	void addChannel(int node, AnimationPath path, AnimationInterpolation interpolation,
+					const float *keyTimes, int keyCount, const float *keyValues);
+};
+
+// Local transform of a node, animated channels overwrite the rest pose
+struct NodePose {
+	glm::vec3 translation;
+	glm::quat rotation;
+	glm::vec3 scale;
+
+	NodePose() : translation(0.0f), rotation(1.0f, 0.0f, 0.0f, 0.0f), scale(1.0f) {}
+	glm::mat4 matrix() const;
+};
+
+// Last key each channel sampled. Playback that moves forward a little each frame
+// only steps the cursor, so a sample costs O(1) per channel instead of a search.
+// One cursor per playing instance of a clip.
+struct AnimationCursor {
+	std::vector<int> keys;
+
+	void reset(const AnimationClip &clip);
+};
+
+// Samples every channel at time (wrapped to the clip's duration) into poses, indexed by node
+void sampleAnimationClip(const AnimationClip &clip, float time, AnimationCursor &cursor, std::vector<NodePose> &poses);
+
+#endif
@@ -0,0 +1,51 @@
+#include "animation_lod.h"
+
+#include <cmath>
+
+AnimationLodLevel selectAnimationLod(const AnimationLodSettings &settings, float distance, bool visible)
+{
+	if (!settings.enabled) {
+		return ANIMATION_LOD_FULL;
+	}
+	if (!visible && settings.freezeCulled) {
+		return ANIMATION_LOD_FROZEN;
+	}
+	return distance < settings.fullDistance ? ANIMATION_LOD_FULL : ANIMATION_LOD_REDUCED;
+}
+
+void AnimationLodStats::reset()
+{
+	for (int i = 0; i < ANIMATION_LOD_LEVEL_COUNT; ++i) {
+		frames[i] = 0;
+	}
+	poseEvaluations = 0;
+}
+
+int ReducedRatePalette::update(float time, float rate, const Evaluate &evaluate, std::vector<glm::vec4> &palette)
+{
+	double position = double(time) * rate;
+	long long current = (long long)std::floor(position);
+	int evaluations = 0;
+
+	if (!valid || rate != this->rate || current != sample) {
+		if (valid && rate == this->rate && current == sample + 1) {
+			// One step forward, the old next sample becomes the previous one
+			previous.swap(next);
+		} else {
+			evaluate(float(current / double(rate)), previous);
+			evaluations++;
+		}
+		evaluate(float((current + 1) / double(rate)), next);
+		evaluations++;
+		this->rate = rate;
+		sample = current;
+		valid = true;
+	}
+
+	float blend = float(position - double(current));
+	palette.resize(previous.size());
+	for (size_t i = 0; i < previous.size(); ++i) {
+		palette[i] = glm::mix(previous[i], next[i], blend);
+	}
+	return evaluations;
+}
@@ -0,0 +1,60 @@
+#ifndef _ANIMATION_LOD_H_
+#define _ANIMATION_LOD_H_
+
+#include <glm/glm.hpp>
+
+#include <functional>
+#include <vector>
+
+// How often a character's pose is evaluated
+enum AnimationLodLevel {
+	ANIMATION_LOD_FULL,			// Every frame
+	ANIMATION_LOD_REDUCED,		// At AnimationLodSettings::reducedRate, blended in between
+	ANIMATION_LOD_FROZEN,		// Not at all, the last pose is held
+	ANIMATION_LOD_LEVEL_COUNT
+};
+static const char *const animationLodLevelNames[] = { "full", "reduced", "frozen" };
+
+struct AnimationLodSettings {
+	bool enabled;				// Off keeps everything at full rate
+	float fullDistance;			// Closer than this to the camera animates every frame
+	float reducedRate;			// Poses per second further out
+	bool freezeCulled;			// Characters outside the view hold their pose
+
+	AnimationLodSettings() : enabled(true), fullDistance(40.0f), reducedRate(10.0f), freezeCulled(true) {}
+};
+
+AnimationLodLevel selectAnimationLod(const AnimationLodSettings &settings, float distance, bool visible);
+
+// Frames spent at each level and poses actually evaluated, since the last reset
+struct AnimationLodStats {
+	int frames[ANIMATION_LOD_LEVEL_COUNT];
+	int poseEvaluations;
+
+	AnimationLodStats() { reset(); }
+	void reset();
+};
+
+// Joint palettes evaluated on a fixed grid of clip times and blended linearly in
+// between, so a character at a reduced rate still moves every frame. The two
+// samples around the current time are kept; moving forward one grid step costs
+// one evaluation.
+struct ReducedRatePalette {
+	typedef std::function<void(float time, std::vector<glm::vec4> &palette)> Evaluate;
+
+	float rate;
+	long long sample;			// Grid index of previous, next is the one after
+	bool valid;
+	std::vector<glm::vec4> previous;
+	std::vector<glm::vec4> next;
+
+	ReducedRatePalette() : rate(0.0f), sample(0), valid(false) {}
+
+	// Blends the palette at time into palette; returns how many poses evaluate() was asked for
+	int update(float time, float rate, const Evaluate &evaluate, std::vector<glm::vec4> &palette);
+
+	// Forget the held samples, e.g. after running at another level
+	void invalidate() { valid = false; }
+};
+
+#endif
@@ -0,0 +1,55 @@
+#include "skeleton.h"
+
+#include <algorithm>
+
+void Skeleton::initialize(const std::vector<int> &jointNodes, const std::vector<int> &parentOfNode)
+{
+	int jointCount = int(jointNodes.size());
+	std::vector<int> jointOfNode(parentOfNode.size(), -1);
+	for (int j = 0; j < jointCount; ++j) {
+		jointOfNode[jointNodes[j]] = j;
+	}
+
+	// Parent joint of each joint, and its depth below the nearest root
+	std::vector<int> parentJoint(jointCount, -1);
+	for (int j = 0; j < jointCount; ++j) {
+		int parent = parentOfNode[jointNodes[j]];
+		parentJoint[j] = parent >= 0 ? jointOfNode[parent] : -1;
+	}
+	std::vector<int> depth(jointCount, 0);
+	for (int j = 0; j < jointCount; ++j) {
+		for (int p = parentJoint[j]; p >= 0 && depth[j] <= jointCount; p = parentJoint[p]) {
+			depth[j]++;
+		}
+	}
+
+	// Sorting by depth puts every parent before its children
+	std::vector<int> order(jointCount);
+	for (int j = 0; j < jointCount; ++j) {
+		order[j] = j;
+	}
+	std::stable_sort(order.begin(), order.end(), [&depth](int a, int b) { return depth[a] < depth[b]; });
+
+	nodes.resize(jointCount);
+	parents.resize(jointCount);
+	jointSlots.resize(jointCount);
+	for (int s = 0; s < jointCount; ++s) {
+		jointSlots[order[s]] = s;
+	}
+	for (int s = 0; s < jointCount; ++s) {
+		int joint = order[s];
+		nodes[s] = jointNodes[joint];
+		parents[s] = parentJoint[joint] >= 0 ? jointSlots[parentJoint[joint]] : -1;
+	}
+
+	localTransforms.assign(jointCount, glm::mat4(1.0f));
+	globalTransforms.assign(jointCount, glm::mat4(1.0f));
+}
+
+void Skeleton::evaluate(const std::vector<NodePose> &poses)
+{
+	for (size_t s = 0; s < nodes.size(); ++s) {
+		localTransforms[s] = poses[nodes[s]].matrix();
+		globalTransforms[s] = parents[s] < 0 ? localTransforms[s] : globalTransforms[parents[s]] * localTransforms[s];
+	}
+}
@@ -0,0 +1,42 @@
+#ifndef _SKELETON_H_
+#define _SKELETON_H_
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+#include "animation_clip.h"
+
+// A skin's joints flattened at load time: slots are ordered so every parent comes
+// before its children, whatever order the asset lists the joints in. Evaluating a
+// pose is then one linear pass over persistent buffers, with no recursion and no
+// allocation. Joints whose parent is not in the skin are roots under the identity.
+struct Skeleton {
+	std::vector<int> nodes;			// Node of each slot
+	std::vector<int> parents;		// Slot of each slot's parent, -1 for roots
+	std::vector<int> jointSlots;	// Slot of each skin joint, in skin order
+
+	std::vector<glm::mat4> localTransforms;
+	std::vector<glm::mat4> globalTransforms;
+
+	// jointNodes in skin order; parentOfNode covers every node in the asset, -1 for roots
+	void initialize(const std::vector<int> &jointNodes, const std::vector<int> &parentOfNode);
+
+	// poses is indexed by node
+	void evaluate(const std::vector<NodePose> &poses);
+
+	const glm::mat4 &jointTransform(int joint) const { return globalTransforms[jointSlots[joint]]; }
+};
+
+// Joint palettes hold three texels per joint, the rows of its 3x4 affine matrix;
+// joint_palette.glsl rebuilds the matrix. The constant bottom row is never stored.
+static const int jointPaletteRows = 3;
+
+inline void storeJointRows(const glm::mat4 &m, glm::vec4 *rows)
+{
+	rows[0] = glm::vec4(m[0][0], m[1][0], m[2][0], m[3][0]);
+	rows[1] = glm::vec4(m[0][1], m[1][1], m[2][1], m[3][1]);
+	rows[2] = glm::vec4(m[0][2], m[1][2], m[2][2], m[3][2]);
+}
+
+#endif
@@ -0,0 +1,415 @@
+#include "asset_cook.h"
+#include "mesh_optimize.h"
+
+#include <glm/gtc/packing.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <glm/gtx/matrix_decompose.hpp>
+#include <stb_image.h>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <map>
+
+namespace {
+	// Halves an RGB8 image with a 2x2 box filter; odd edges repeat their last texel
+	void downsample(const unsigned char *source, uint32_t width, uint32_t height, unsigned char *destination)
+	{
+		uint32_t w = width > 1 ? width / 2 : 1, h = height > 1 ? height / 2 : 1;
+		for (uint32_t y = 0; y < h; ++y) {
+			uint32_t y0 = std::min(2 * y, height - 1), y1 = std::min(2 * y + 1, height - 1);
+			for (uint32_t x = 0; x < w; ++x) {
+				uint32_t x0 = std::min(2 * x, width - 1), x1 = std::min(2 * x + 1, width - 1);
+				for (int c = 0; c < 3; ++c) {
+					unsigned sum = source[(y0 * width + x0) * 3 + c] + source[(y0 * width + x1) * 3 + c] +
+								   source[(y1 * width + x0) * 3 + c] + source[(y1 * width + x1) * 3 + c];
+					destination[(y * w + x) * 3 + c] = (unsigned char)((sum + 2) / 4);
+				}
+			}
+		}
+	}
+
+	// Appends one image's level 0, and its mip chain down to 1x1 when levels > 1
+	void appendLevels(const unsigned char *image, const PackedTextureHeader &header, std::vector<unsigned char> &pixels)
+	{
+		size_t first = pixels.size();
+		pixels.insert(pixels.end(), image, image + packedLevelSize(header.width, header.height, 0));
+		for (uint32_t level = 1; level < header.levels; ++level) {
+			size_t previous = first;
+			for (uint32_t l = 0; l + 1 < level; ++l) {
+				previous += packedLevelSize(header.width, header.height, l);
+			}
+			size_t offset = pixels.size();
+			pixels.resize(offset + packedLevelSize(header.width, header.height, level));
+			downsample(&pixels[previous], std::max(header.width >> (level - 1), 1u),
+					   std::max(header.height >> (level - 1), 1u), &pixels[offset]);
+		}
+	}
+
+	// Component c of element i of an accessor, normalized integers mapped to [0, 1]
+	float accessorComponent(const GltfAsset &asset, const tinygltf::Accessor &accessor, size_t i, int c)
+	{
+		const tinygltf::BufferView &bufferView = asset.model.bufferViews[accessor.bufferView];
+		int componentSize = tinygltf::GetComponentSizeInBytes(accessor.componentType);
+		const unsigned char *p = asset.bufferViewData(bufferView) + accessor.byteOffset +
+			i * accessor.ByteStride(bufferView) + c * componentSize;
+		switch (accessor.componentType) {
+		case TINYGLTF_COMPONENT_TYPE_FLOAT: {
+			float value;
+			memcpy(&value, p, sizeof(value));
+			return value;
+		}
+		case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+			return accessor.normalized ? p[0] / 255.0f : float(p[0]);
+		case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: {
+			uint16_t value;
+			memcpy(&value, p, sizeof(value));
+			return accessor.normalized ? value / 65535.0f : float(value);
+		}
+		case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT: {
+			uint32_t value;
+			memcpy(&value, p, sizeof(value));
+			return float(value);
+		}
+		}
+		return 0.0f;
+	}
+
+	// Up to count components of every element of a primitive's attribute, false when it has none
+	bool readAttribute(const GltfAsset &asset, const tinygltf::Primitive &primitive, const char *name,
+					   size_t vertex, int count, float *values)
+	{
+		std::map<std::string, int>::const_iterator attribute = primitive.attributes.find(name);
+		if (attribute == primitive.attributes.end()) {
+			return false;
+		}
+		const tinygltf::Accessor &accessor = asset.model.accessors[attribute->second];
+		int components = std::min(count, tinygltf::GetNumComponentsInType(accessor.type));
+		for (int c = 0; c < components; ++c) {
+			values[c] = accessorComponent(asset, accessor, vertex, c);
+		}
+		return true;
+	}
+
+	uint32_t indexAt(const GltfAsset &asset, const tinygltf::Accessor &accessor, size_t i)
+	{
+		return uint32_t(accessorComponent(asset, accessor, i, 0));
+	}
+
+	// Float contents of an accessor, tightly packed
+	bool readFloats(const GltfAsset &asset, int accessorIndex, std::vector<float> &data)
+	{
+		const tinygltf::Accessor &accessor = asset.model.accessors[accessorIndex];
+		if (accessor.componentType != TINYGLTF_COMPONENT_TYPE_FLOAT || accessor.bufferView < 0) {
+			std::cout << "Unsupported animation accessor " << accessorIndex << std::endl;
+			return false;
+		}
+		const tinygltf::BufferView &bufferView = asset.model.bufferViews[accessor.bufferView];
+		int components = tinygltf::GetNumComponentsInType(accessor.type);
+		int stride = accessor.ByteStride(bufferView);
+		const unsigned char *ptr = asset.bufferViewData(bufferView) + accessor.byteOffset;
+
+		data.resize(accessor.count * components);
+		for (size_t i = 0; i < accessor.count; ++i) {
+			memcpy(&data[i * components], ptr + i * stride, components * sizeof(float));
+		}
+		return true;
+	}
+
+	// Weights to unorm8 that still sum to 255, the rounding error goes to the largest
+	void quantizeWeights(const float *weights, uint8_t *quantized)
+	{
+		float sum = weights[0] + weights[1] + weights[2] + weights[3];
+		if (sum <= 0.0f) {
+			quantized[0] = 255;
+			quantized[1] = quantized[2] = quantized[3] = 0;
+			return;
+		}
+		int total = 0, largest = 0;
+		for (int j = 0; j < 4; ++j) {
+			quantized[j] = uint8_t(glm::clamp(weights[j] / sum * 255.0f + 0.5f, 0.0f, 255.0f));
+			total += quantized[j];
+			largest = quantized[j] > quantized[largest] ? j : largest;
+		}
+		quantized[largest] = uint8_t(glm::clamp(quantized[largest] + 255 - total, 0, 255));
+	}
+
+	// Bytes per vertex of the attributes as exported, for the report
+	size_t sourceVertexSize(const GltfAsset &asset, const tinygltf::Primitive &primitive)
+	{
+		static const char *const attributes[] = { "POSITION", "NORMAL", "TEXCOORD_0", "JOINTS_0", "WEIGHTS_0" };
+		size_t size = 0;
+		for (const char *name : attributes) {
+			std::map<std::string, int>::const_iterator attribute = primitive.attributes.find(name);
+			if (attribute != primitive.attributes.end()) {
+				const tinygltf::Accessor &accessor = asset.model.accessors[attribute->second];
+				size += tinygltf::GetComponentSizeInBytes(accessor.componentType) * tinygltf::GetNumComponentsInType(accessor.type);
+			}
+		}
+		return size;
+	}
+
+	bool cookPrimitive(const GltfAsset &asset, const tinygltf::Primitive &primitive, int skin, PackedModel &model,
+					   std::vector<uint32_t> &indices)
+	{
+		const tinygltf::Accessor &positions = asset.model.accessors[primitive.attributes.at("POSITION")];
+		const tinygltf::Accessor &indexAccessor = asset.model.accessors[primitive.indices];
+
+		PackedPrimitive packed;
+		packed.mode = primitive.mode;
+		packed.indexCount = uint32_t(indexAccessor.count);
+		packed.firstIndex = uint32_t(indices.size());
+		packed.baseVertex = uint32_t(model.vertices.size());
+		packed.vertexCount = uint32_t(positions.count);
+		packed.skin = skin;
+		model.primitives.push_back(packed);
+
+		std::vector<PackedVertex> vertices(positions.count);
+		for (size_t i = 0; i < positions.count; ++i) {
+			PackedVertex &vertex = vertices[i];
+			float normal[3] = {}, uv[2] = {}, joints[4] = {}, weights[4] = { 1.0f, 0.0f, 0.0f, 0.0f };
+			readAttribute(asset, primitive, "POSITION", i, 3, vertex.position);
+			readAttribute(asset, primitive, "NORMAL", i, 3, normal);
+			readAttribute(asset, primitive, "TEXCOORD_0", i, 2, uv);
+			readAttribute(asset, primitive, "JOINTS_0", i, 4, joints);
+			readAttribute(asset, primitive, "WEIGHTS_0", i, 4, weights);
+
+			vertex.normal = glm::packSnorm3x10_1x2(glm::vec4(normal[0], normal[1], normal[2], 0.0f));
+			vertex.uv[0] = glm::packHalf1x16(uv[0]);
+			vertex.uv[1] = glm::packHalf1x16(uv[1]);
+			for (int j = 0; j < 4; ++j) {
+				if (joints[j] > 255.0f) {
+					std::cout << "Joint " << joints[j] << " does not fit the 8-bit joint attribute" << std::endl;
+					return false;
+				}
+				vertex.joints[j] = uint8_t(joints[j]);
+			}
+			quantizeWeights(weights, vertex.weights);
+		}
+
+		std::vector<uint32_t> primitiveIndices(indexAccessor.count);
+		for (size_t i = 0; i < indexAccessor.count; ++i) {
+			primitiveIndices[i] = indexAt(asset, indexAccessor, i);
+		}
+
+		// Triangle lists are reordered for the post-transform cache, then overdraw, then
+		// their vertices for fetch locality
+		if (primitive.mode == TINYGLTF_MODE_TRIANGLES && !vertices.empty()) {
+			float before = computeACMR(primitiveIndices, vertices.size());
+			optimizeVertexCache(primitiveIndices, vertices.size());
+			float cacheOrdered = computeACMR(primitiveIndices, vertices.size());
+			optimizeOverdraw(primitiveIndices, vertices[0].position, sizeof(PackedVertex), vertices.size());
+			float after = computeACMR(primitiveIndices, vertices.size());
+
+			std::vector<uint32_t> remap = optimizeVertexFetch(primitiveIndices, vertices.size());
+			std::vector<PackedVertex> ordered(vertices.size());
+			for (size_t v = 0; v < vertices.size(); ++v) {
+				ordered[remap[v]] = vertices[v];
+			}
+			vertices.swap(ordered);
+
+			std::cout << "Primitive " << model.primitives.size() - 1 << ": " << primitiveIndices.size() / 3
+					  << " triangles, ACMR " << before << " as exported, " << cacheOrdered << " cache ordered, "
+					  << after << " with overdraw order (FIFO " << meshCacheSize << ")" << std::endl;
+		}
+		std::cout << "Primitive " << model.primitives.size() - 1 << ": " << sourceVertexSize(asset, primitive)
+				  << " bytes per vertex as exported, " << sizeof(PackedVertex) << " cooked" << std::endl;
+
+		model.vertices.insert(model.vertices.end(), vertices.begin(), vertices.end());
+		indices.insert(indices.end(), primitiveIndices.begin(), primitiveIndices.end());
+		return true;
+	}
+
+	bool cookNode(const GltfAsset &asset, const tinygltf::Node &node, PackedModel &model, std::vector<uint32_t> &indices)
+	{
+		if (node.mesh >= 0 && node.mesh < int(asset.model.meshes.size())) {
+			const tinygltf::Mesh &mesh = asset.model.meshes[node.mesh];
+			for (size_t i = 0; i < mesh.primitives.size(); ++i) {
+				if (!cookPrimitive(asset, mesh.primitives[i], node.skin, model, indices)) {
+					return false;
+				}
+			}
+		}
+		for (size_t i = 0; i < node.children.size(); ++i) {
+			if (!cookNode(asset, asset.model.nodes[node.children[i]], model, indices)) {
+				return false;
+			}
+		}
+		return true;
+	}
+}
+bool cookTexture(const std::string &path, bool mipmaps, PackedTexture &texture)
+{
+	int w, h, channels;
+	unsigned char *image = stbi_load(path.c_str(), &w, &h, &channels, 3);
+	if (!image) {
+		std::cout << "Failed to load texture " << path << std::endl;
+		return false;
+	}
+	texture.header.width = uint32_t(w);
+	texture.header.height = uint32_t(h);
+	texture.header.levels = 1;
+	texture.header.faces = 1;
+	while (mipmaps && (std::max(texture.header.width, texture.header.height) >> texture.header.levels) > 0) {
+		texture.header.levels++;
+	}
+	texture.pixels.clear();
+	appendLevels(image, texture.header, texture.pixels);
+	texture.data = texture.pixels.data();
+	stbi_image_free(image);
+	return true;
+}
+
+bool cookCubemap(const std::vector<std::string> &faces, PackedTexture &texture)
+{
+	texture.header.levels = 1;
+	texture.header.faces = uint32_t(faces.size());
+	texture.pixels.clear();
+	for (size_t i = 0; i < faces.size(); ++i) {
+		int w, h, channels;
+		unsigned char *image = stbi_load(faces[i].c_str(), &w, &h, &channels, 3);
+		if (!image) {
+			std::cout << "Cubemap texture failed to load at path: " << faces[i] << std::endl;
+			return false;
+		}
+		if (i > 0 && (uint32_t(w) != texture.header.width || uint32_t(h) != texture.header.height)) {
+			std::cout << "Cubemap face " << faces[i] << " is not the size of the first" << std::endl;
+			stbi_image_free(image);
+			return false;
+		}
+		texture.header.width = uint32_t(w);
+		texture.header.height = uint32_t(h);
+		appendLevels(image, texture.header, texture.pixels);
+		stbi_image_free(image);
+	}
+	texture.data = texture.pixels.data();
+	return true;
+}
+
+bool cookModel(const GltfAsset &asset, PackedModel &model)
+{
+	const tinygltf::Model &source = asset.model;
+	if (source.scenes.empty()) {
+		return false;
+	}
+
+	// Scene order, as the renderer binds primitives
+	model = PackedModel();
+	std::vector<uint32_t> indices;
+	const tinygltf::Scene &scene = source.scenes[source.defaultScene >= 0 ? source.defaultScene : 0];
+	for (size_t i = 0; i < scene.nodes.size(); ++i) {
+		if (!cookNode(asset, source.nodes[scene.nodes[i]], model, indices)) {
+			return false;
+		}
+	}
+
+	// Indices are relative to each primitive's base vertex, so 16 bits do unless a primitive is larger
+	uint32_t largest = 0;
+	for (size_t i = 0; i < model.primitives.size(); ++i) {
+		largest = std::max(largest, model.primitives[i].vertexCount);
+	}
+	model.indexSize = largest <= 0xFFFF ? 2 : 4;
+	model.indices.resize(indices.size() * model.indexSize);
+	for (size_t i = 0; i < indices.size(); ++i) {
+		if (model.indexSize == 2) {
+			uint16_t index = uint16_t(indices[i]);
+			memcpy(&model.indices[i * 2], &index, 2);
+		} else {
+			memcpy(&model.indices[i * 4], &indices[i], 4);
+		}
+	}
+
+	model.skins = gltfSkins(asset);
+	model.parentOfNode = gltfParentOfNode(source);
+	model.restPose = gltfRestPose(source);
+	model.clips = compileGltfClips(asset);
+	return true;
+}
+
+std::vector<AnimationClip> compileGltfClips(const GltfAsset &asset)
+{
+	std::vector<AnimationClip> clips;
+	std::vector<float> keyTimes, keyValues;
+	for (const auto &anim : asset.model.animations) {
+		AnimationClip clip;
+		for (const auto &channel : anim.channels) {
+			const tinygltf::AnimationSampler &sampler = anim.samplers[channel.sampler];
+
+			AnimationPath path;
+			if (channel.target_path == "translation") path = ANIMATION_PATH_TRANSLATION;
+			else if (channel.target_path == "rotation") path = ANIMATION_PATH_ROTATION;
+			else if (channel.target_path == "scale") path = ANIMATION_PATH_SCALE;
+			else continue;	// Morph target weights are not supported
+
+			AnimationInterpolation interpolation = ANIMATION_INTERPOLATION_LINEAR;
+			if (sampler.interpolation == "STEP") interpolation = ANIMATION_INTERPOLATION_STEP;
+			else if (sampler.interpolation == "CUBICSPLINE") interpolation = ANIMATION_INTERPOLATION_CUBICSPLINE;
+
+			if (!readFloats(asset, sampler.input, keyTimes) || !readFloats(asset, sampler.output, keyValues)) {
+				continue;
+			}
+			clip.addChannel(channel.target_node, path, interpolation, keyTimes.data(), int(keyTimes.size()), keyValues.data());
+		}
+		clips.push_back(clip);
+	}
+	return clips;
+}
+
+std::vector<NodePose> gltfRestPose(const tinygltf::Model &model)
+{
+	std::vector<NodePose> poses(model.nodes.size());
+	for (size_t i = 0; i < model.nodes.size(); ++i) {
+		const tinygltf::Node &node = model.nodes[i];
+		NodePose &pose = poses[i];
+		if (node.matrix.size() == 16) {
+			glm::vec3 skew;
+			glm::vec4 perspective;
+			glm::decompose(glm::mat4(glm::make_mat4(node.matrix.data())), pose.scale, pose.rotation, pose.translation, skew, perspective);
+			continue;
+		}
+		if (node.translation.size() == 3) {
+			pose.translation = glm::vec3(node.translation[0], node.translation[1], node.translation[2]);
+		}
+		if (node.rotation.size() == 4) {
+			pose.rotation = glm::quat(node.rotation[3], node.rotation[0], node.rotation[1], node.rotation[2]);
+		}
+		if (node.scale.size() == 3) {
+			pose.scale = glm::vec3(node.scale[0], node.scale[1], node.scale[2]);
+		}
+	}
+	return poses;
+}
+
+std::vector<int> gltfParentOfNode(const tinygltf::Model &model)
+{
+	std::vector<int> parentOfNode(model.nodes.size(), -1);
+	for (size_t n = 0; n < model.nodes.size(); ++n) {
+		for (int child : model.nodes[n].children) {
+			parentOfNode[child] = int(n);
+		}
+	}
+	return parentOfNode;
+}
+
+std::vector<PackedSkin> gltfSkins(const GltfAsset &asset)
+{
+	std::vector<PackedSkin> skins;
+	for (size_t i = 0; i < asset.model.skins.size(); ++i) {
+		const tinygltf::Skin &skin = asset.model.skins[i];
+		PackedSkin packed;
+		packed.joints = skin.joints;
+
+		// Identity when the skin has no inverse bind matrices
+		packed.inverseBindMatrices.assign(skin.joints.size(), glm::mat4(1.0f));
+		if (skin.inverseBindMatrices >= 0) {
+			std::vector<float> matrices;
+			if (readFloats(asset, skin.inverseBindMatrices, matrices)) {
+				for (size_t j = 0; j < packed.inverseBindMatrices.size() && (j + 1) * 16 <= matrices.size(); ++j) {
+					packed.inverseBindMatrices[j] = glm::make_mat4(&matrices[j * 16]);
+				}
+			}
+		}
+		skins.push_back(packed);
+	}
+	return skins;
+}
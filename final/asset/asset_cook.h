@@ -0,0 +1,32 @@
+#ifndef _ASSET_COOK_H_
+#define _ASSET_COOK_H_
+
+#include <string>
+#include <vector>
+
+#include "asset_pack.h"
+#include "gltf_asset.h"
+
+// Conversions from source assets to what the renderer keeps. assetc runs them
+// offline into a pack; the renderer runs the glTF ones itself when there is no pack.
+
+// Decodes an image to RGB8, with its whole mip chain from a 2x2 box filter when mipmaps is set
+bool cookTexture(const std::string &path, bool mipmaps, PackedTexture &texture);
+
+// Six same-sized faces in GL_TEXTURE_CUBE_MAP_POSITIVE_X order, level 0 only
+bool cookCubemap(const std::vector<std::string> &faces, PackedTexture &texture);
+
+// Flattens the default scene's primitives into one interleaved stream and compiles the rest
+bool cookModel(const GltfAsset &asset, PackedModel &model);
+
+// Channels resolved to nodes and enums once, so playback never reads the glTF again
+std::vector<AnimationClip> compileGltfClips(const GltfAsset &asset);
+
+// Node transforms from the glTF, the pose every clip starts from
+std::vector<NodePose> gltfRestPose(const tinygltf::Model &model);
+
+std::vector<int> gltfParentOfNode(const tinygltf::Model &model);
+
+std::vector<PackedSkin> gltfSkins(const GltfAsset &asset);
+
+#endif
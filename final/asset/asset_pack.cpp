@@ -0,0 +1,297 @@
+#include "asset_pack.h"
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+namespace {
+	const size_t blobAlignment = 16;
+
+	size_t alignUp(size_t size)
+	{
+		return (size + blobAlignment - 1) / blobAlignment * blobAlignment;
+	}
+
+	// Appends values to a blob; arrays are a count, then their elements 16 byte aligned
+	struct BlobWriter {
+		std::vector<unsigned char> &blob;
+
+		explicit BlobWriter(std::vector<unsigned char> &blob) : blob(blob) {}
+
+		void bytes(const void *data, size_t size)
+		{
+			const unsigned char *p = static_cast<const unsigned char *>(data);
+			blob.insert(blob.end(), p, p + size);
+		}
+
+		template <typename T>
+		void value(const T &v)
+		{
+			bytes(&v, sizeof(T));
+		}
+
+		template <typename T>
+		void array(const std::vector<T> &v)
+		{
+			value(uint32_t(v.size()));
+			blob.resize(alignUp(blob.size()), 0);
+			if (!v.empty()) {
+				bytes(v.data(), v.size() * sizeof(T));
+			}
+		}
+	};
+
+	// Mirror of BlobWriter over a blob in the pack; stops at the end instead of reading past it
+	struct BlobReader {
+		const unsigned char *begin;
+		const unsigned char *p;
+		const unsigned char *end;
+		bool ok;
+
+		BlobReader(const unsigned char *data, size_t size) : begin(data), p(data), end(data + size), ok(true) {}
+
+		const unsigned char *bytes(size_t size)
+		{
+			if (!ok || size_t(end - p) < size) {
+				ok = false;
+				return nullptr;
+			}
+			const unsigned char *data = p;
+			p += size;
+			return data;
+		}
+
+		template <typename T>
+		T value()
+		{
+			T v = T();
+			const unsigned char *data = bytes(sizeof(T));
+			if (data) {
+				memcpy(&v, data, sizeof(T));
+			}
+			return v;
+		}
+
+		// An element count, no larger than the bytes left so a corrupt one cannot allocate much
+		uint32_t count()
+		{
+			uint32_t n = value<uint32_t>();
+			if (n > size_t(end - p)) {
+				ok = false;
+				return 0;
+			}
+			return n;
+		}
+
+		template <typename T>
+		void array(std::vector<T> &v)
+		{
+			uint32_t count = this->count();
+			bytes(alignUp(size_t(p - begin)) - size_t(p - begin));
+			const unsigned char *data = bytes(size_t(count) * sizeof(T));
+			v.resize(data ? count : 0);
+			if (data && count > 0) {
+				memcpy(&v[0], data, size_t(count) * sizeof(T));
+			}
+		}
+	};
+}
+
+const unsigned char *PackedTexture::image(uint32_t face, uint32_t level) const
+{
+	size_t offset = 0;
+	for (uint32_t f = 0; f <= face; ++f) {
+		for (uint32_t l = 0; l < header.levels; ++l) {
+			if (f == face && l == level) {
+				return data + offset;
+			}
+			offset += packedLevelSize(header.width, header.height, l);
+		}
+	}
+	return nullptr;
+}
+
+void AssetPackWriter::addTexture(const std::string &name, const PackedTexture &texture)
+{
+	std::vector<unsigned char> blob;
+	BlobWriter writer(blob);
+	writer.value(texture.header);
+	writer.bytes(texture.pixels.data(), texture.pixels.size());
+	addEntry(name, ASSET_PACK_TEXTURE, blob);
+}
+
+void AssetPackWriter::addModel(const std::string &name, const PackedModel &model)
+{
+	std::vector<unsigned char> blob;
+	BlobWriter writer(blob);
+	writer.value(model.indexSize);
+	writer.array(model.vertices);
+	writer.array(model.indices);
+	writer.array(model.primitives);
+	writer.value(uint32_t(model.skins.size()));
+	for (size_t i = 0; i < model.skins.size(); ++i) {
+		writer.array(model.skins[i].joints);
+		writer.array(model.skins[i].inverseBindMatrices);
+	}
+	writer.array(model.parentOfNode);
+	writer.array(model.restPose);
+	writer.value(uint32_t(model.clips.size()));
+	for (size_t i = 0; i < model.clips.size(); ++i) {
+		writer.value(model.clips[i].duration);
+		writer.array(model.clips[i].channels);
+		writer.array(model.clips[i].times);
+		writer.array(model.clips[i].values);
+	}
+	addEntry(name, ASSET_PACK_MODEL, blob);
+}
+
+void AssetPackWriter::addEntry(const std::string &name, AssetPackEntryType type, std::vector<unsigned char> &blob)
+{
+	AssetPackEntry entry;
+	memset(&entry, 0, sizeof(entry));
+	strncpy(entry.name, name.c_str(), sizeof(entry.name) - 1);
+	entry.type = type;
+	entry.size = blob.size();
+	entries.push_back(entry);
+	blobs.push_back(std::vector<unsigned char>());
+	blobs.back().swap(blob);
+}
+
+bool AssetPackWriter::write(const std::string &path) const
+{
+	AssetPackHeader header;
+	memcpy(header.magic, assetPackMagic, sizeof(header.magic));
+	header.version = assetPackVersion;
+	header.entryCount = uint32_t(entries.size());
+	header.reserved = 0;
+
+	// Blobs follow the table, each at an aligned offset
+	std::vector<AssetPackEntry> table = entries;
+	size_t offset = alignUp(sizeof(header) + table.size() * sizeof(AssetPackEntry));
+	for (size_t i = 0; i < table.size(); ++i) {
+		table[i].offset = offset;
+		offset = alignUp(offset + table[i].size);
+	}
+
+	FILE *file = fopen(path.c_str(), "wb");
+	if (!file) {
+		std::cout << "Failed to create asset pack " << path << std::endl;
+		return false;
+	}
+	static const unsigned char padding[blobAlignment] = {};
+	size_t written = sizeof(header) + table.size() * sizeof(AssetPackEntry);
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+	ok = ok && (table.empty() || fwrite(table.data(), sizeof(AssetPackEntry), table.size(), file) == table.size());
+	for (size_t i = 0; ok && i < table.size(); ++i) {
+		ok = fwrite(padding, 1, table[i].offset - written, file) == table[i].offset - written;
+		ok = ok && fwrite(blobs[i].data(), 1, blobs[i].size(), file) == blobs[i].size();
+		written = table[i].offset + table[i].size;
+	}
+	ok = fclose(file) == 0 && ok;
+	if (!ok) {
+		std::cout << "Failed to write asset pack " << path << std::endl;
+	}
+	return ok;
+}
+
+bool AssetPack::open(const std::string &path)
+{
+	close();
+	if (!file.open(path)) {
+		return false;
+	}
+
+	const AssetPackHeader *candidate = reinterpret_cast<const AssetPackHeader *>(file.data());
+	if (file.size() < sizeof(AssetPackHeader) || memcmp(candidate->magic, assetPackMagic, sizeof(assetPackMagic)) != 0) {
+		std::cout << "Not an asset pack: " << path << std::endl;
+		file.close();
+		return false;
+	}
+	if (candidate->version != assetPackVersion) {
+		std::cout << "Asset pack " << path << " is version " << candidate->version << ", this build reads "
+				  << assetPackVersion << "; cook it again" << std::endl;
+		file.close();
+		return false;
+	}
+	if (file.size() < sizeof(AssetPackHeader) + size_t(candidate->entryCount) * sizeof(AssetPackEntry)) {
+		std::cout << "Truncated asset pack: " << path << std::endl;
+		file.close();
+		return false;
+	}
+	header = candidate;
+	entries = reinterpret_cast<const AssetPackEntry *>(file.data() + sizeof(AssetPackHeader));
+	return true;
+}
+
+void AssetPack::close()
+{
+	file.close();
+	header = nullptr;
+	entries = nullptr;
+}
+
+const AssetPackEntry *AssetPack::find(const std::string &name, AssetPackEntryType type) const
+{
+	if (!header) {
+		return nullptr;
+	}
+	for (uint32_t i = 0; i < header->entryCount; ++i) {
+		const AssetPackEntry &entry = entries[i];
+		if (entry.type == uint32_t(type) && strncmp(entry.name, name.c_str(), sizeof(entry.name)) == 0 &&
+			entry.offset <= file.size() && entry.size <= file.size() - entry.offset) {
+			return &entry;
+		}
+	}
+	return nullptr;
+}
+
+bool AssetPack::texture(const std::string &name, PackedTexture &texture) const
+{
+	const AssetPackEntry *entry = find(name, ASSET_PACK_TEXTURE);
+	if (!entry) {
+		return false;
+	}
+	BlobReader reader(file.data() + entry->offset, size_t(entry->size));
+	texture.header = reader.value<PackedTextureHeader>();
+	if (texture.header.levels > 32 || texture.header.faces > 6) {
+		return false;
+	}
+	size_t size = 0;
+	for (uint32_t level = 0; level < texture.header.levels; ++level) {
+		size += packedLevelSize(texture.header.width, texture.header.height, level);
+	}
+	texture.pixels.clear();
+	texture.data = reader.bytes(size * texture.header.faces);
+	return reader.ok && texture.header.levels > 0;
+}
+
+bool AssetPack::model(const std::string &name, PackedModel &model) const
+{
+	const AssetPackEntry *entry = find(name, ASSET_PACK_MODEL);
+	if (!entry) {
+		return false;
+	}
+	BlobReader reader(file.data() + entry->offset, size_t(entry->size));
+	model.indexSize = reader.value<uint32_t>();
+	reader.array(model.vertices);
+	reader.array(model.indices);
+	reader.array(model.primitives);
+	model.skins.resize(reader.count());
+	for (size_t i = 0; reader.ok && i < model.skins.size(); ++i) {
+		reader.array(model.skins[i].joints);
+		reader.array(model.skins[i].inverseBindMatrices);
+	}
+	reader.array(model.parentOfNode);
+	reader.array(model.restPose);
+	model.clips.resize(reader.count());
+	for (size_t i = 0; reader.ok && i < model.clips.size(); ++i) {
+		model.clips[i].duration = reader.value<float>();
+		reader.array(model.clips[i].channels);
+		reader.array(model.clips[i].times);
+		reader.array(model.clips[i].values);
+	}
+	if (!reader.ok) {
+		std::cout << "Corrupt model " << name << " in asset pack" << std::endl;
+	}
+	return reader.ok;
+}
@@ -0,0 +1,148 @@
+#ifndef _ASSET_PACK_H_
+#define _ASSET_PACK_H_
+
+#include <glm/glm.hpp>
+#include <animation/animation_clip.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "mapped_file.h"
+
+// Binary pack cooked by assetc at build time and memory-mapped by the renderer.
+// A header, a table of entries, then one blob per entry at a 16 byte aligned
+// offset. Blobs hold the structs below as the compiler laid them out, so a pack
+// is only read by binaries from the same build; the version changes whenever
+// any of them does.
+static const char assetPackMagic[4] = { 'A', 'P', 'A', 'K' };
+static const uint32_t assetPackVersion = 2;
+
+enum AssetPackEntryType {
+	ASSET_PACK_TEXTURE = 1,
+	ASSET_PACK_MODEL = 2
+};
+
+struct AssetPackHeader {
+	char magic[4];
+	uint32_t version;
+	uint32_t entryCount;
+	uint32_t reserved;
+};
+
+struct AssetPackEntry {
+	char name[56];			// Source file name, null-terminated
+	uint32_t type;
+	uint32_t reserved;
+	uint64_t offset;		// From the start of the pack
+	uint64_t size;
+};
+
+// RGB8 texture, faces * levels images stored face by face, each from level 0 down
+// with rows tightly packed. The pixels follow this header in the blob.
+struct PackedTextureHeader {
+	uint32_t width;
+	uint32_t height;
+	uint32_t levels;
+	uint32_t faces;
+};
+
+// Bytes of one RGB8 image of a mip level
+inline size_t packedLevelSize(uint32_t width, uint32_t height, uint32_t level)
+{
+	uint32_t w = width >> level, h = height >> level;
+	return size_t(w > 0 ? w : 1) * (h > 0 ? h : 1) * 3;
+}
+
+struct PackedTexture {
+	PackedTextureHeader header;
+	std::vector<unsigned char> pixels;		// Filled when cooking
+	const unsigned char *data;				// Pixels, in pixels or in the mapped pack
+
+	PackedTexture() : data(nullptr) { header.width = header.height = header.levels = header.faces = 0; }
+
+	// First byte of one face's level
+	const unsigned char *image(uint32_t face, uint32_t level) const;
+};
+
+// One interleaved vertex, every attribute the skinning pre-pass reads, quantized:
+// the normal as signed normalized 10_10_10_2, the UV as half floats, joints as
+// 8-bit integers and weights as unorm8 summing to 255. 28 bytes.
+struct PackedVertex {
+	float position[3];
+	uint32_t normal;
+	uint16_t uv[2];
+	uint8_t joints[4];
+	uint8_t weights[4];
+};
+
+// Primitive of a cooked model: its indices are relative to baseVertex. Triangle
+// lists are ordered for the post-transform cache and overdraw, and their vertices
+// in order of first use.
+struct PackedPrimitive {
+	uint32_t mode;
+	uint32_t indexCount;
+	uint32_t firstIndex;
+	uint32_t baseVertex;
+	uint32_t vertexCount;
+	int32_t skin;
+};
+
+struct PackedSkin {
+	std::vector<int> joints;						// Nodes, in skin order
+	std::vector<glm::mat4> inverseBindMatrices;
+};
+
+// Everything the renderer builds from a skinned glTF at load time: one vertex
+// stream and one index stream for all primitives, in scene order, plus the
+// skins, the node hierarchy and rest pose, and the compiled clips
+struct PackedModel {
+	std::vector<PackedVertex> vertices;
+	std::vector<unsigned char> indices;
+	uint32_t indexSize;								// 2 or 4 bytes
+	std::vector<PackedPrimitive> primitives;
+	std::vector<PackedSkin> skins;
+	std::vector<int> parentOfNode;					// -1 for roots
+	std::vector<NodePose> restPose;
+	std::vector<AnimationClip> clips;
+
+	PackedModel() : indexSize(2) {}
+};
+
+// Collects cooked entries and writes the pack in one go
+struct AssetPackWriter {
+	void addTexture(const std::string &name, const PackedTexture &texture);
+	void addModel(const std::string &name, const PackedModel &model);
+
+	bool write(const std::string &path) const;
+
+private:
+	void addEntry(const std::string &name, AssetPackEntryType type, std::vector<unsigned char> &blob);
+
+	std::vector<AssetPackEntry> entries;
+	std::vector<std::vector<unsigned char> > blobs;
+};
+
+// A mapped pack. Textures are read in place; models are copied out since the
+// renderer keeps their CPU side anyway.
+struct AssetPack {
+	bool open(const std::string &path);
+	void close();
+	bool isOpen() const { return header != nullptr; }
+
+	// The entry of that name and type, null when the pack has none
+	const AssetPackEntry *find(const std::string &name, AssetPackEntryType type) const;
+
+	// data points into the pack, valid until close()
+	bool texture(const std::string &name, PackedTexture &texture) const;
+	bool model(const std::string &name, PackedModel &model) const;
+
+	AssetPack() : header(nullptr), entries(nullptr) {}
+
+private:
+	MappedFile file;
+	const AssetPackHeader *header;
+	const AssetPackEntry *entries;
+};
+
+#endif
@@ -0,0 +1,66 @@
+// assetc: cooks the renderer's source assets into the binary pack it loads at startup.
+//
+//   assetc <source directory> <pack>
+//
+// The source directory is final/. Textures are decoded and mipmapped, the bot is
+// flattened into interleaved vertices and its clips compiled, all with the code
+// the renderer would otherwise run at every start.
+#define TINYGLTF_IMPLEMENTATION
+#define STB_IMAGE_IMPLEMENTATION
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "asset_cook.h"
+
+#include <chrono>
+#include <iostream>
+
+int main(int argc, char **argv)
+{
+	if (argc != 3) {
+		std::cerr << "Usage: assetc <source directory> <pack>" << std::endl;
+		return 1;
+	}
+	std::string source = std::string(argv[1]) + "/";
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	AssetPackWriter writer;
+
+	// Entries are named after their source file; the renderer looks them up the same way
+	static const char *const mipmappedTextures[] = { "cloudySea.jpg", "skin.png" };
+	for (const char *name : mipmappedTextures) {
+		PackedTexture texture;
+		if (cookTexture(source + name, true, texture)) {
+			writer.addTexture(name, texture);
+			std::cout << "Cooked " << name << ": " << texture.header.width << "x" << texture.header.height
+					  << ", " << texture.header.levels << " levels" << std::endl;
+		}
+	}
+
+	std::vector<std::string> faces = {
+		source + "right.jpg", source + "left.jpg",
+		source + "top.jpg", source + "bottom.jpg",
+		source + "front.jpg", source + "back.jpg"
+	};
+	PackedTexture skybox;
+	if (cookCubemap(faces, skybox)) {
+		writer.addTexture("skybox", skybox);
+		std::cout << "Cooked skybox: " << skybox.header.faces << " faces of " << skybox.header.width << "x"
+				  << skybox.header.height << std::endl;
+	}
+
+	// Copying is fine here, the asset only lives until it is cooked
+	GltfAsset bot;
+	PackedModel model;
+	if (!bot.load(source + "model/bot/bot.gltf", GLTF_LOAD_COPY) || !cookModel(bot, model)) {
+		std::cerr << "Failed to cook the bot" << std::endl;
+		return 1;
+	}
+	writer.addModel("bot.gltf", model);
+	std::cout << "Cooked bot.gltf: " << model.primitives.size() << " primitives, " << model.vertices.size()
+			  << " vertices, " << model.clips.size() << " clips" << std::endl;
+
+	if (!writer.write(argv[2])) {
+		return 1;
+	}
+	double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+	std::cout << "Wrote " << argv[2] << " in " << milliseconds << " ms" << std::endl;
+	return 0;
+}
@@ -0,0 +1,186 @@
+#include "gltf_asset.h"
+
+#include <json.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+
+namespace {
+	const uint32_t glbMagic = 0x46546C67;		// "glTF"
+	const uint32_t glbChunkJSON = 0x4E4F534A;
+	const uint32_t glbChunkBIN = 0x004E4942;
+
+	// Stands in for a mapped buffer so tinygltf has nothing to read
+	const char *placeholderBufferURI = "data:application/octet-stream;base64,AA==";
+
+	uint32_t readU32(const unsigned char *p)
+	{
+		uint32_t value;
+		memcpy(&value, p, sizeof(value));
+		return value;
+	}
+
+	std::string directoryOf(const std::string &path)
+	{
+		size_t slash = path.find_last_of("/\\");
+		return slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+	}
+
+	bool isGLB(const unsigned char *data, size_t size)
+	{
+		return size >= 12 && readU32(data) == glbMagic;
+	}
+}
+
+bool GltfAsset::load(const std::string &path, GltfLoadMode mode)
+{
+	model = tinygltf::Model();
+	bufferBytes.clear();
+	mappings.clear();
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	std::string err;
+	std::string warn;
+	bool res;
+	if (mode == GLTF_LOAD_MAPPED) {
+		res = loadMapped(path, err, warn);
+	} else {
+		tinygltf::TinyGLTF loader;
+		bool binary = path.size() >= 4 && path.compare(path.size() - 4, 4, ".glb") == 0;
+		res = binary ? loader.LoadBinaryFromFile(&model, &err, &warn, path)
+					 : loader.LoadASCIIFromFile(&model, &err, &warn, path);
+		for (size_t i = 0; res && i < model.buffers.size(); ++i) {
+			bufferBytes.push_back(model.buffers[i].data.data());
+		}
+	}
+	double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	if (!warn.empty()) {
+		std::cout << "WARN: " << warn << std::endl;
+	}
+
+	if (!err.empty()) {
+		std::cout << "ERR: " << err << std::endl;
+	}
+
+	if (!res)
+		std::cout << "Failed to load glTF: " << path << std::endl;
+	else
+		std::cout << "Loaded glTF: " << path << " (" << (mode == GLTF_LOAD_MAPPED ? "mapped" : "copied")
+				  << ", " << milliseconds << " ms)" << std::endl;
+
+	return res;
+}
+
+const unsigned char *GltfAsset::bufferViewData(const tinygltf::BufferView &bufferView) const
+{
+	return bufferBytes[bufferView.buffer] + bufferView.byteOffset;
+}
+
+bool GltfAsset::loadMapped(const std::string &path, std::string &err, std::string &warn)
+{
+	std::unique_ptr<MappedFile> file(new MappedFile());
+	if (!file->open(path)) {
+		err = "Cannot map " + path;
+		return false;
+	}
+
+	// A .glb is a 12 byte header then chunks: JSON first, then an optional BIN
+	const unsigned char *data = file->data();
+	size_t size = file->size();
+	const char *json = reinterpret_cast<const char *>(data);
+	size_t jsonLength = size;
+	const unsigned char *binData = nullptr;
+	size_t binLength = 0;
+	bool binary = isGLB(data, size);
+	if (binary) {
+		size_t total = readU32(data + 8);
+		if (readU32(data + 4) != 2 || total > size || total < 20 || readU32(data + 16) != glbChunkJSON) {
+			err = "Invalid GLB header in " + path;
+			return false;
+		}
+		jsonLength = readU32(data + 12);
+		json = reinterpret_cast<const char *>(data + 20);
+		size_t binChunk = 20 + ((jsonLength + 3) & ~size_t(3));
+		if (20 + jsonLength > total) {
+			err = "GLB JSON chunk exceeds the file in " + path;
+			return false;
+		}
+		if (binChunk + 8 <= total && readU32(data + binChunk + 4) == glbChunkBIN) {
+			binLength = readU32(data + binChunk);
+			binData = data + binChunk + 8;
+			if (binChunk + 8 + binLength > total) {
+				err = "GLB BIN chunk exceeds the file in " + path;
+				return false;
+			}
+		}
+	}
+
+	nlohmann::json document = nlohmann::json::parse(json, json + jsonLength, nullptr, false);
+	if (document.is_discarded() || !document.is_object()) {
+		err = "Invalid glTF JSON in " + path;
+		return false;
+	}
+
+	// Images stored in buffer views are decoded by tinygltf from model.buffers, which mapping
+	// would leave empty; such assets are copied instead
+	bool imagesInBuffers = false;
+	if (document.count("images")) {
+		for (const nlohmann::json &image : document["images"]) {
+			imagesInBuffers = imagesInBuffers || image.count("bufferView") != 0;
+		}
+	}
+	tinygltf::TinyGLTF loader;
+	std::string directory = directoryOf(path);
+	if (imagesInBuffers) {
+		warn += "Images in buffer views, " + path + " is copied instead of mapped\n";
+		bool res = binary ? loader.LoadBinaryFromMemory(&model, &err, &warn, data, (unsigned int)size, directory)
+						  : loader.LoadASCIIFromString(&model, &err, &warn, json, (unsigned int)jsonLength, directory);
+		for (size_t i = 0; res && i < model.buffers.size(); ++i) {
+			bufferBytes.push_back(model.buffers[i].data.data());
+		}
+		return res;
+	}
+
+	// Point each buffer at its bytes in a mapping and hide it from tinygltf
+	std::vector<const unsigned char *> mapped;
+	if (document.count("buffers")) {
+		for (nlohmann::json &buffer : document["buffers"]) {
+			size_t byteLength = buffer.value("byteLength", size_t(0));
+			std::string uri = buffer.value("uri", std::string());
+			const unsigned char *bytes = nullptr;
+			if (uri.empty()) {
+				if (!binData || byteLength > binLength) {
+					err = "Buffer without a uri needs a GLB BIN chunk of its size in " + path;
+					return false;
+				}
+				bytes = binData;
+			} else if (uri.compare(0, 5, "data:") != 0) {
+				std::unique_ptr<MappedFile> external(new MappedFile());
+				if (!external->open(directory + uri) || external->size() < byteLength) {
+					err = "Cannot map buffer " + directory + uri;
+					return false;
+				}
+				bytes = external->data();
+				mappings.push_back(std::move(external));
+			}
+			if (bytes) {
+				buffer["uri"] = placeholderBufferURI;
+				buffer["byteLength"] = 1;
+			}
+			mapped.push_back(bytes);
+		}
+	}
+	mappings.push_back(std::move(file));
+
+	std::string rewritten = document.dump();
+	if (!loader.LoadASCIIFromString(&model, &err, &warn, rewritten.c_str(), (unsigned int)rewritten.size(), directory)) {
+		return false;
+	}
+	for (size_t i = 0; i < model.buffers.size(); ++i) {
+		bufferBytes.push_back(i < mapped.size() && mapped[i] ? mapped[i] : model.buffers[i].data.data());
+	}
+	return true;
+}
@@ -0,0 +1,36 @@
+#ifndef _GLTF_ASSET_H_
+#define _GLTF_ASSET_H_
+
+#include <tiny_gltf.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mapped_file.h"
+
+enum GltfLoadMode {
+	GLTF_LOAD_COPY,			// tinygltf reads every buffer into model.buffers
+	GLTF_LOAD_MAPPED		// Buffers stay in memory-mapped files, tinygltf only parses the JSON
+};
+
+// A .gltf or .glb file, picked by its header. Read buffer contents through
+// bufferViewData(), never model.buffers: when mapped, each buffer is a range of
+// the .glb's BIN chunk or of its external .bin file, and model.buffers only
+// holds placeholders. Embedded data URIs are always decoded by tinygltf.
+struct GltfAsset {
+	tinygltf::Model model;
+
+	bool load(const std::string &path, GltfLoadMode mode);
+
+	// First byte of a buffer view, valid for as long as the asset is loaded
+	const unsigned char *bufferViewData(const tinygltf::BufferView &bufferView) const;
+
+private:
+	bool loadMapped(const std::string &path, std::string &err, std::string &warn);
+
+	std::vector<const unsigned char *> bufferBytes;
+	std::vector<std::unique_ptr<MappedFile> > mappings;
+};
+
+#endif
@@ -0,0 +1,36 @@
+#ifndef _MAPPED_FILE_H_
+#define _MAPPED_FILE_H_
+
+#include <cstddef>
+#include <string>
+
+// Read-only view of a whole file through the OS page cache. Pages come in from
+// disk on first touch, so handing a range to glBufferData streams it to the
+// driver without reading it into a heap buffer first.
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	bool open(const std::string &path);
+	void close();
+
+	const unsigned char *data() const { return bytes; }
+	size_t size() const { return length; }
+
+private:
+	MappedFile(const MappedFile &);
+	MappedFile &operator=(const MappedFile &);
+
+	const unsigned char *bytes;
+	size_t length;
+#ifdef _WIN32
+	void *fileHandle;
+	void *mappingHandle;
+#else
+	int descriptor;
+#endif
+};
+
+#endif
@@ -0,0 +1,267 @@
+#include "mesh_optimize.h"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+	// Forsyth's scoring: the cache he models is bigger than the FIFO the reports assume,
+	// which keeps the order good on hardware with any cache size
+	const int scoringCacheSize = 32;
+	const float cacheDecayPower = 1.5f;
+	const float lastTriangleScore = 0.75f;
+	const float valenceBoostScale = 2.0f;
+	const float valenceBoostPower = 0.5f;
+
+	// The overdraw order is dropped if it loses more cache hits than this
+	const float overdrawACMRThreshold = 1.05f;
+
+	float vertexScore(int cachePosition, int remainingTriangles)
+	{
+		if (remainingTriangles == 0) {
+			return -1.0f;
+		}
+		float score = 0.0f;
+		if (cachePosition >= 0) {
+			// The last triangle's vertices score a fixed amount so it is not simply repeated
+			score = cachePosition < 3 ? lastTriangleScore :
+				std::pow(1.0f - float(cachePosition - 3) / (scoringCacheSize - 3), cacheDecayPower);
+		}
+
+		// Finish off vertices with few triangles left, or they end up transformed again later
+		return score + valenceBoostScale * std::pow(float(remainingTriangles), -valenceBoostPower);
+	}
+}
+
+float computeACMR(const std::vector<uint32_t> &indices, size_t vertexCount, int cacheSize)
+{
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0) {
+		return 0.0f;
+	}
+
+	// A vertex is cached while fewer than cacheSize misses came after its own
+	std::vector<uint32_t> missTime(vertexCount, 0);
+	uint32_t time = uint32_t(cacheSize) + 1;
+	size_t misses = 0;
+	for (size_t i = 0; i < triangleCount * 3; ++i) {
+		uint32_t v = indices[i];
+		if (time - missTime[v] > uint32_t(cacheSize)) {
+			missTime[v] = time++;
+			misses++;
+		}
+	}
+	return float(misses) / float(triangleCount);
+}
+
+void optimizeVertexCache(std::vector<uint32_t> &indices, size_t vertexCount)
+{
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0) {
+		return;
+	}
+
+	// Triangles around each vertex; the first remaining[v] of a vertex's list are not emitted yet
+	std::vector<uint32_t> adjacencyOffset(vertexCount + 1, 0);
+	for (size_t i = 0; i < triangleCount * 3; ++i) {
+		adjacencyOffset[indices[i] + 1]++;
+	}
+	for (size_t v = 0; v < vertexCount; ++v) {
+		adjacencyOffset[v + 1] += adjacencyOffset[v];
+	}
+	std::vector<uint32_t> adjacency(triangleCount * 3);
+	std::vector<int> remaining(vertexCount, 0);
+	for (size_t t = 0; t < triangleCount; ++t) {
+		for (int k = 0; k < 3; ++k) {
+			uint32_t v = indices[t * 3 + k];
+			adjacency[adjacencyOffset[v] + remaining[v]++] = uint32_t(t);
+		}
+	}
+
+	std::vector<int> cachePosition(vertexCount, -1);
+	std::vector<float> scores(vertexCount);
+	for (size_t v = 0; v < vertexCount; ++v) {
+		scores[v] = vertexScore(-1, remaining[v]);
+	}
+	std::vector<float> triangleScores(triangleCount);
+	std::vector<bool> emitted(triangleCount, false);
+	int best = 0;
+	for (size_t t = 0; t < triangleCount; ++t) {
+		triangleScores[t] = scores[indices[t * 3]] + scores[indices[t * 3 + 1]] + scores[indices[t * 3 + 2]];
+		if (triangleScores[t] > triangleScores[best]) {
+			best = int(t);
+		}
+	}
+
+	std::vector<uint32_t> ordered;
+	ordered.reserve(triangleCount * 3);
+	std::vector<uint32_t> cache, nextCache;
+	size_t nextUnemitted = 0;
+	while (best >= 0) {
+		emitted[best] = true;
+		const uint32_t *triangle = &indices[best * 3];
+		ordered.insert(ordered.end(), triangle, triangle + 3);
+
+		// Take the triangle off its vertices' lists
+		for (int k = 0; k < 3; ++k) {
+			uint32_t v = triangle[k];
+			uint32_t *list = &adjacency[adjacencyOffset[v]];
+			for (int i = 0; i < remaining[v]; ++i) {
+				if (list[i] == uint32_t(best)) {
+					std::swap(list[i], list[remaining[v] - 1]);
+					break;
+				}
+			}
+			remaining[v]--;
+		}
+
+		// The triangle's vertices move to the front, the rest shift back
+		nextCache.assign(triangle, triangle + 3);
+		for (size_t i = 0; i < cache.size(); ++i) {
+			if (cache[i] != triangle[0] && cache[i] != triangle[1] && cache[i] != triangle[2]) {
+				nextCache.push_back(cache[i]);
+			}
+		}
+		for (size_t i = 0; i < nextCache.size(); ++i) {
+			uint32_t v = nextCache[i];
+			cachePosition[v] = i < size_t(scoringCacheSize) ? int(i) : -1;
+			scores[v] = vertexScore(cachePosition[v], remaining[v]);
+		}
+
+		// Next is the best triangle touching the cache, or failing that the first one left
+		best = -1;
+		float bestScore = -1.0f;
+		for (size_t i = 0; i < nextCache.size(); ++i) {
+			uint32_t v = nextCache[i];
+			const uint32_t *list = &adjacency[adjacencyOffset[v]];
+			for (int j = 0; j < remaining[v]; ++j) {
+				uint32_t t = list[j];
+				triangleScores[t] = scores[indices[t * 3]] + scores[indices[t * 3 + 1]] + scores[indices[t * 3 + 2]];
+				if (triangleScores[t] > bestScore) {
+					bestScore = triangleScores[t];
+					best = int(t);
+				}
+			}
+		}
+		if (nextCache.size() > size_t(scoringCacheSize)) {
+			nextCache.resize(scoringCacheSize);
+		}
+		cache.swap(nextCache);
+
+		while (best < 0 && nextUnemitted < triangleCount) {
+			if (!emitted[nextUnemitted]) {
+				best = int(nextUnemitted);
+			}
+			nextUnemitted++;
+		}
+	}
+	indices.swap(ordered);
+}
+
+void optimizeOverdraw(std::vector<uint32_t> &indices, const float *positions, size_t positionStride, size_t vertexCount)
+{
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0) {
+		return;
+	}
+	const unsigned char *positionBytes = reinterpret_cast<const unsigned char *>(positions);
+	struct Position {
+		const unsigned char *bytes;
+		size_t stride;
+		glm::vec3 operator()(uint32_t v) const {
+			const float *p = reinterpret_cast<const float *>(bytes + v * stride);
+			return glm::vec3(p[0], p[1], p[2]);
+		}
+	} position = { positionBytes, positionStride };
+
+	// Runs start where a triangle misses the cache on all three vertices
+	std::vector<size_t> runStarts;
+	std::vector<uint32_t> missTime(vertexCount, 0);
+	uint32_t time = uint32_t(meshCacheSize) + 1;
+	for (size_t t = 0; t < triangleCount; ++t) {
+		int misses = 0;
+		for (int k = 0; k < 3; ++k) {
+			uint32_t v = indices[t * 3 + k];
+			if (time - missTime[v] > uint32_t(meshCacheSize)) {
+				missTime[v] = time++;
+				misses++;
+			}
+		}
+		if (misses == 3) {
+			runStarts.push_back(t);
+		}
+	}
+	runStarts.push_back(triangleCount);
+
+	// Area-weighted centroid and normal of each run, against the mesh centroid
+	struct Run {
+		size_t first, end;
+		glm::vec3 centroid;
+		glm::vec3 normal;
+		float sortKey;
+	};
+	std::vector<Run> runs(runStarts.size() - 1);
+	glm::vec3 meshCentroid(0.0f);
+	float meshArea = 0.0f;
+	for (size_t r = 0; r < runs.size(); ++r) {
+		Run &run = runs[r];
+		run.first = runStarts[r];
+		run.end = runStarts[r + 1];
+		run.centroid = glm::vec3(0.0f);
+		run.normal = glm::vec3(0.0f);
+		float area = 0.0f;
+		for (size_t t = run.first; t < run.end; ++t) {
+			glm::vec3 a = position(indices[t * 3]), b = position(indices[t * 3 + 1]), c = position(indices[t * 3 + 2]);
+			glm::vec3 n = glm::cross(b - a, c - a);
+			float triangleArea = glm::length(n);
+			run.centroid += (a + b + c) * (triangleArea / 3.0f);
+			run.normal += n;
+			area += triangleArea;
+		}
+		meshCentroid += run.centroid;
+		meshArea += area;
+		run.centroid = area > 0.0f ? run.centroid / area : position(indices[run.first * 3]);
+	}
+	if (meshArea > 0.0f) {
+		meshCentroid /= meshArea;
+	}
+	for (size_t r = 0; r < runs.size(); ++r) {
+		Run &run = runs[r];
+		float length = glm::length(run.normal);
+		run.sortKey = length > 0.0f ? glm::dot(run.centroid - meshCentroid, run.normal / length) : 0.0f;
+	}
+
+	// Outermost runs first
+	std::stable_sort(runs.begin(), runs.end(), [](const Run &a, const Run &b) { return a.sortKey > b.sortKey; });
+	std::vector<uint32_t> ordered;
+	ordered.reserve(indices.size());
+	for (size_t r = 0; r < runs.size(); ++r) {
+		ordered.insert(ordered.end(), indices.begin() + runs[r].first * 3, indices.begin() + runs[r].end * 3);
+	}
+
+	// Runs can reuse vertices their predecessor left in the cache; keep the order that loses few
+	if (computeACMR(ordered, vertexCount) <= overdrawACMRThreshold * computeACMR(indices, vertexCount)) {
+		indices.swap(ordered);
+	}
+}
+
+std::vector<uint32_t> optimizeVertexFetch(std::vector<uint32_t> &indices, size_t vertexCount)
+{
+	const uint32_t unused = ~0u;
+	std::vector<uint32_t> remap(vertexCount, unused);
+	uint32_t next = 0;
+	for (size_t i = 0; i < indices.size(); ++i) {
+		uint32_t &index = indices[i];
+		if (remap[index] == unused) {
+			remap[index] = next++;
+		}
+		index = remap[index];
+	}
+	for (size_t v = 0; v < vertexCount; ++v) {
+		if (remap[v] == unused) {
+			remap[v] = next++;
+		}
+	}
+	return remap;
+}
@@ -0,0 +1,31 @@
+#ifndef _MESH_OPTIMIZE_H_
+#define _MESH_OPTIMIZE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Triangle list reordering run by the cooker, in this order: cache, overdraw, fetch.
+// Indices are 0 based over vertexCount vertices.
+
+// FIFO size the ACMR reports assume, about what current hardware reuses
+static const int meshCacheSize = 16;
+
+// Average cache miss ratio: vertices transformed per triangle with a FIFO post-transform
+// cache of cacheSize entries. 3 with no reuse, around 0.6 is very good for a closed mesh.
+float computeACMR(const std::vector<uint32_t> &indices, size_t vertexCount, int cacheSize = meshCacheSize);
+
+// Orders triangles so vertices are reused while still in the post-transform cache
+// (Forsyth, "Linear-Speed Vertex Cache Optimisation")
+void optimizeVertexCache(std::vector<uint32_t> &indices, size_t vertexCount);
+
+// Splits cache-ordered triangles into runs that start with a full cache miss and draws
+// outward facing runs first, so they occlude the rest; costs almost no cache hits.
+// positions are three floats per vertex, positionStride bytes apart.
+void optimizeOverdraw(std::vector<uint32_t> &indices, const float *positions, size_t positionStride, size_t vertexCount);
+
+// Renumbers vertices in order of first use so fetches walk memory forward, unused vertices
+// last. Rewrites indices and returns remap[old vertex] = new vertex.
+std::vector<uint32_t> optimizeVertexFetch(std::vector<uint32_t> &indices, size_t vertexCount);
+
+#endif
@@ -0,0 +1,27 @@
+// Skinning matrices baked per frame by bakeAnimationClip(), three texels (the rows
+// of a 3x4 affine matrix) per joint and one texture row per frame.
+// Include joint_palette.glsl first.
+uniform sampler2D bakedPalette;
+uniform vec3 bakedClip;     // x: sample rate, y: duration, z: frame count
+
+vec4 bakedRow(int frame, int texel) {
+    return texelFetch(bakedPalette, ivec2(texel, frame), 0);
+}
+
+// Joint matrix at a time in seconds, looped and blended between the two nearest frames
+mat4 bakedJointMatrix(float time, int joint) {
+    float clipTime = mod(time, bakedClip.y);
+    int lastFrame = int(bakedClip.z) - 1;
+    int frame0 = clamp(int(clipTime * bakedClip.x), 0, max(lastFrame - 1, 0));
+    int frame1 = min(frame0 + 1, lastFrame);
+
+    // The last frame is at the clip's end, not a whole sample interval after the one before
+    float time0 = float(frame0) / bakedClip.x;
+    float time1 = min(float(frame1) / bakedClip.x, bakedClip.y);
+    float blend = time1 > time0 ? clamp((clipTime - time0) / (time1 - time0), 0.0, 1.0) : 0.0;
+
+    int texel = 3 * joint;
+    return jointRowsMatrix(mix(bakedRow(frame0, texel), bakedRow(frame1, texel), blend),
+                           mix(bakedRow(frame0, texel + 1), bakedRow(frame1, texel + 1), blend),
+                           mix(bakedRow(frame0, texel + 2), bakedRow(frame1, texel + 2), blend));
+}
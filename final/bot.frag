@@ -1,22 +1,22 @@
 #version 330 core
 
+#include "frame_uniforms.glsl"
+
 in vec3 worldPosition;
 in vec3 worldNormal; 
 in vec2 uv;
 
 out vec3 finalColor;
 
-uniform vec3 lightPosition;
-uniform vec3 lightIntensity;
 uniform sampler2D textureSampler;  
 
 void main()
 {
 	// Lighting
-	vec3 lightDir = lightPosition - worldPosition;
+	vec3 lightDir = lightPosition.xyz - worldPosition;
 	float lightDist = dot(lightDir, lightDir);
 	lightDir = normalize(lightDir);
-	vec3 v = lightIntensity * clamp(dot(lightDir, worldNormal), 0.0, 1.0) / lightDist;
+	vec3 v = lightIntensity.xyz * clamp(dot(lightDir, worldNormal), 0.0, 1.0) / lightDist;
 
 	// Tone mapping
 	v = v / (1.0 + v);
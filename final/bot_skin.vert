@@ -0,0 +1,28 @@
+#version 330 core
+
+#include "skinning.glsl"
+
+// Skinning pre-pass, run once per pose with rasterisation off. Every pass that
+// draws the bot reads the captured vertices instead of skinning again.
+layout(location = 0) in vec3 vertexPosition;
+layout(location = 1) in vec3 vertexNormal;
+layout(location = 2) in vec2 vertexUV;
+
+// Captured by transform feedback, interleaved in this order
+out vec3 skinnedPosition;
+out vec3 skinnedNormal;
+out vec2 skinnedUV;
+
+uniform mat4 modelMatrix;
+
+void main() {
+    mat4 skin = skinMatrix();
+    vec4 pos = modelMatrix * skin * vec4(vertexPosition, 1.0);
+
+    // World-space geometry
+    skinnedPosition = pos.xyz;
+    skinnedNormal = normalize(mat3(modelMatrix) * mat3(skin) * vertexNormal);
+    skinnedUV = vertexUV;
+
+    gl_Position = pos;
+}
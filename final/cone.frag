@@ -1,15 +1,16 @@
 #version 330 core
+#extension GL_ARB_texture_gather : enable
+
+#include "frame_uniforms.glsl"
+#include "shadow.glsl"
 
 in vec3 worldPosition;
 in vec3 worldNormal; 
-in vec4 fragPosLightSpace;
 
 out vec3 finalColor;
 
-uniform sampler2D shadowMap;
 uniform samplerCube skybox; 
-uniform vec3 lightDir;       
-uniform vec3 cameraPos;       
+uniform int receiveShadows;
 
 void main()
 {
@@ -18,14 +19,14 @@ void main()
     vec3 surfaceColor = vec3(0.5); 
 
     vec3 normal = normalize(worldNormal);
-    vec3 lightDirNorm = normalize(lightDir);
+    vec3 lightDirNorm = lightDirection.xyz;
 
     // Diffuse and ambient
-    float diffuse = max(dot(normal, -lightDir), 0.0);
+    float diffuse = max(dot(normal, -lightDirNorm), 0.0);
     vec3 lighting = ambientColor * surfaceColor + diffuse * surfaceColor;
 
     // Specular highlights
-    vec3 viewDir = normalize(cameraPos - worldPosition);
+    vec3 viewDir = normalize(cameraPosition.xyz - worldPosition);
     vec3 halfVector = normalize(-lightDirNorm + viewDir);  
     float specular = pow(max(dot(normal, halfVector), 0.0), 16.0); 
     vec3 specularColor = vec3(1.0) * specular * 0.3; 
@@ -37,14 +38,7 @@ void main()
     envColor *= 0.6; 
 
     // Shadows
-    vec3 uv = fragPosLightSpace.xyz / fragPosLightSpace.w;
-    uv = uv * 0.5 + 0.5; 
-    if (uv.x < 0.0 || uv.x > 1.0 || uv.y < 0.0 || uv.y > 1.0 || uv.z > 1.0) {
-        uv.z = 1.0;
-    }
-    float existingDepth = texture(shadowMap, uv.xy).r;
-    float bias = max(0.005 * (1.0 - dot(normal, lightDirNorm)), 0.0005); 
-    float shadow = (uv.z > existingDepth + bias) ? 0.2 : 1.0;
+    float shadow = receiveShadows != 0 ? mix(0.2, 1.0, shadowVisibility(worldPosition, normal)) : 1.0;
 
     lighting = (lighting + specularColor) * shadow;
 
@@ -1,24 +1,20 @@
 #version 330 core
 
+#include "frame_uniforms.glsl"
+
 layout(location = 0) in vec3 vertexPosition;
 layout(location = 1) in vec3 vertexColor;
 layout(location = 2) in vec3 vertexNormal;
 
 out vec3 worldPosition;
 out vec3 worldNormal;
-out vec4 fragPosLightSpace;
 
-uniform mat4 MVP;
-uniform mat4 lightSpaceMatrix;
+uniform mat4 modelMatrix;
+uniform mat3 normalMatrix;
 
 void main() {
-    gl_Position =  MVP * vec4(vertexPosition, 1); 
-    worldPosition = vertexPosition;
-    worldNormal = vertexNormal;
-    fragPosLightSpace = lightSpaceMatrix * vec4(worldPosition, 1.0);
+    vec4 position = modelMatrix * vec4(vertexPosition, 1);
+    gl_Position =  viewProjection * position; 
+    worldPosition = position.xyz;
+    worldNormal = normalMatrix * vertexNormal;
 }
-
-
-
-
-
@@ -0,0 +1,54 @@
+#version 330 core
+
+#include "frame_uniforms.glsl"
+#include "joint_palette.glsl"
+#include "baked_animation.glsl"
+
+// Skinned bot drawn instanced over a crowd. Each character's texels in crowdData
+// are a header (model origin in world space, clip time offset) followed by its
+// joint palette, three rows per joint. With baked animation only the headers are
+// written and every character plays the baked clip from its own time offset.
+layout(location = 0) in vec3 vertexPosition;
+layout(location = 1) in vec3 vertexNormal;
+layout(location = 2) in vec2 vertexUV;
+layout(location = 3) in uvec4 a_joint;
+layout(location = 4) in vec4 a_weight;
+
+out vec3 worldPosition;
+out vec3 worldNormal;
+out vec2 uv;
+
+uniform samplerBuffer crowdData;
+uniform int instanceStride;     // Texels per character
+uniform mat4 modelMatrix;       // Scale and orientation shared by the crowd
+uniform int shadowPass;         // Project with the light instead of the camera
+uniform int cascadeIndex;       // Shadow cascade drawn by the shadow pass
+uniform int bakedSkinning;
+uniform float animationTime;
+
+mat4 jointMatrix(int base, float time, uint joint) {
+    if (bakedSkinning != 0) {
+        return bakedJointMatrix(time, int(joint));
+    }
+    return paletteJointMatrix(crowdData, base + 1 + 3 * int(joint));
+}
+
+void main() {
+    int base = gl_InstanceID * instanceStride;
+    vec4 header = texelFetch(crowdData, base);
+    float time = animationTime + header.w;
+
+    mat4 skin = a_weight.x * jointMatrix(base, time, a_joint.x)
+              + a_weight.y * jointMatrix(base, time, a_joint.y)
+              + a_weight.z * jointMatrix(base, time, a_joint.z)
+              + a_weight.w * jointMatrix(base, time, a_joint.w);
+    vec4 pos = vec4(header.xyz, 0.0) + modelMatrix * skin * vec4(vertexPosition, 1.0);
+
+    gl_Position = (shadowPass != 0 ? lightSpaceMatrices[cascadeIndex] : viewProjection) * pos;
+
+    // World-space geometry
+    worldNormal = normalize(mat3(modelMatrix) * mat3(skin) * vertexNormal);
+    worldPosition = pos.xyz;
+
+    uv = vertexUV;
+}
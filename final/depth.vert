@@ -1,9 +1,13 @@
 #version 330 core
+
+#include "frame_uniforms.glsl"
+
 layout (location = 0) in vec3 aPos;
 
-uniform mat4 lightSpaceMatrix;
+uniform mat4 modelMatrix;
+uniform int cascadeIndex;
 
 void main()
 {
-    gl_Position = lightSpaceMatrix * vec4(aPos, 1.0);
-}  
\ No newline at end of file
+    gl_Position = lightSpaceMatrices[cascadeIndex] * modelMatrix * vec4(aPos, 1.0);
+}  
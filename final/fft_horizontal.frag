@@ -1,34 +1,26 @@
 #version 330 core
 
-uniform sampler2D inputTexture; 
-uniform int passNumber;          
-uniform float time;
+uniform sampler2DArray inputTexture;  // Two complex values per texel, two layers
+uniform sampler2D butterflyTexture;  // twiddle.xy, source indices.zw per (x, stage)
+uniform int stage;
 
-out vec4 FragColor;
+layout(location = 0) out vec4 FragColor0;
+layout(location = 1) out vec4 FragColor1;
 
-void main()
+// Stockham butterfly on both complex values of a texel: a + twiddle * b
+vec4 butterflyPair(vec4 a, vec4 b, vec2 twiddle)
 {
-    ivec2 texelCoords = ivec2(gl_FragCoord.xy);  
-    float stepSize = float(1 << passNumber);
-
-    // Calculate offsets for texel
-    vec2 texelSize = vec2(1.0) / textureSize(inputTexture, 0); 
-    vec2 offsetA = texelCoords * texelSize;  
-    vec2 offsetB = (texelCoords - ivec2(stepSize, 0)) * texelSize;  
-
-    // Sample texture
-    vec2 valueA = texture(inputTexture, offsetA).xy;
-    vec2 valueB = texture(inputTexture, offsetB).xy;
-
-    // Twiddle factor
-    float angle = -2.0 * 3.14159265359 * float(texelCoords.x % int(stepSize)) / float(stepSize);
-    float phaseShift = time * 0.1;  // Time-based phase shift
-    angle += phaseShift;
-    vec2 twiddle = vec2(cos(angle), sin(angle));
+    return a + vec4(twiddle.x * b.x - twiddle.y * b.y, twiddle.x * b.y + twiddle.y * b.x,
+                    twiddle.x * b.z - twiddle.y * b.w, twiddle.x * b.w + twiddle.y * b.z);
+}
 
-    // Butterfly operation
-    vec2 combined = valueA + twiddle * valueB;
-    combined += sin(time * 0.1 + float(texelCoords.x) * 0.01) * 0.5;
+void main()
+{
+    ivec2 texelCoords = ivec2(gl_FragCoord.xy);
+    vec4 butterfly = texelFetch(butterflyTexture, ivec2(texelCoords.x, stage), 0);
 
-    FragColor = vec4(combined, 0.0, 1.0);
+    FragColor0 = butterflyPair(texelFetch(inputTexture, ivec3(int(butterfly.z), texelCoords.y, 0), 0),
+                               texelFetch(inputTexture, ivec3(int(butterfly.w), texelCoords.y, 0), 0), butterfly.xy);
+    FragColor1 = butterflyPair(texelFetch(inputTexture, ivec3(int(butterfly.z), texelCoords.y, 1), 0),
+                               texelFetch(inputTexture, ivec3(int(butterfly.w), texelCoords.y, 1), 0), butterfly.xy);
 }
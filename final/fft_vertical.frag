@@ -1,34 +1,26 @@
 #version 330 core
 
-uniform sampler2D horizontalPassTexture;
-uniform int passNumber; 
-uniform float time;
+uniform sampler2DArray inputTexture;  // Two complex values per texel, two layers
+uniform sampler2D butterflyTexture;  // twiddle.xy, source indices.zw per (y, stage)
+uniform int stage;
 
-out vec4 FragColor;
+layout(location = 0) out vec4 FragColor0;
+layout(location = 1) out vec4 FragColor1;
+
+// Stockham butterfly on both complex values of a texel: a + twiddle * b
+vec4 butterflyPair(vec4 a, vec4 b, vec2 twiddle)
+{
+    return a + vec4(twiddle.x * b.x - twiddle.y * b.y, twiddle.x * b.y + twiddle.y * b.x,
+                    twiddle.x * b.z - twiddle.y * b.w, twiddle.x * b.w + twiddle.y * b.z);
+}
 
 void main()
 {
     ivec2 texelCoords = ivec2(gl_FragCoord.xy);
-    float stepSize = float(1 << passNumber);
-
-    // Calculate offsets for texel
-    vec2 texelSize = vec2(1.0) / textureSize(horizontalPassTexture, 0);
-    vec2 offsetA = vec2(texelCoords.x, texelCoords.y) * texelSize;
-    vec2 offsetB = vec2(texelCoords.x, texelCoords.y - stepSize) * texelSize;
-
-    // Sample the data
-    vec2 valueA = texture(horizontalPassTexture, offsetA).xy;
-    vec2 valueB = texture(horizontalPassTexture, offsetB).xy;
-
-    // Twiddle factor
-    float angle = -2.0 * 3.14159265359 * float(texelCoords.y % int(stepSize)) / (2.0 * stepSize);
-    float phaseShift = time * 0.1;  // Time-based phase shift
-    angle += phaseShift;
-    vec2 twiddle = vec2(cos(angle), sin(angle));
-
-    // Combine the results (Butterfly operation)
-    vec2 combined = valueA + twiddle * valueB;
+    vec4 butterfly = texelFetch(butterflyTexture, ivec2(texelCoords.y, stage), 0);
 
-    // Write the result
-    FragColor = vec4(combined, 0.0, 1.0);
-}
\ No newline at end of file
+    FragColor0 = butterflyPair(texelFetch(inputTexture, ivec3(texelCoords.x, int(butterfly.z), 0), 0),
+                               texelFetch(inputTexture, ivec3(texelCoords.x, int(butterfly.w), 0), 0), butterfly.xy);
+    FragColor1 = butterflyPair(texelFetch(inputTexture, ivec3(texelCoords.x, int(butterfly.z), 1), 0),
+                               texelFetch(inputTexture, ivec3(texelCoords.x, int(butterfly.w), 1), 0), butterfly.xy);
+}
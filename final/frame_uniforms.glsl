@@ -0,0 +1,14 @@
+// Shared per-frame data, mirrored by FrameUniformData in render/program.h
+#define MAX_SHADOW_CASCADES 4
+
+layout(std140) uniform FrameUniforms {
+    mat4 viewProjection;
+    mat4 lightSpaceMatrices[2 * MAX_SHADOW_CASCADES];    // The cascades, then their cached static layers
+    vec4 cameraPosition;
+    vec4 cameraDirection;
+    vec4 cascadeSplits;     // View depth where each cascade ends
+    vec4 shadowParameters;  // x: cascade count, y: filter mode
+    vec4 lightDirection;    // xyz: direction the light travels
+    vec4 lightPosition;
+    vec4 lightIntensity;
+};
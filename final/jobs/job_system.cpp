@@ -0,0 +1,185 @@
+#include "job_system.h"
+
+#include <algorithm>
+#include <cstdint>
+
+// Which scheduler the current thread works for and its deque there
+static thread_local const JobSystem *slotOwner = nullptr;
+static thread_local int slotIndex = 0;
+
+JobSystem::JobSystem() : queuedJobs(0), quit(false)
+{
+}
+
+JobSystem::~JobSystem()
+{
+	cleanup();
+}
+
+void JobSystem::initialize(int threadCount)
+{
+	cleanup();
+	if (threadCount <= 0) {
+		threadCount = int(std::thread::hardware_concurrency());
+	}
+	threadCount = std::max(threadCount, 1);
+
+	quit = false;
+	queuedJobs = 0;
+	for (int i = 0; i < threadCount; ++i) {
+		queues.push_back(std::unique_ptr<WorkerQueue>(new WorkerQueue()));
+	}
+	slotOwner = this;
+	slotIndex = 0;
+	for (int i = 1; i < threadCount; ++i) {
+		workers.push_back(std::thread(&JobSystem::workerLoop, this, i));
+	}
+}
+
+void JobSystem::cleanup()
+{
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+		quit = true;
+	}
+	wake.notify_all();
+	for (size_t i = 0; i < workers.size(); ++i) {
+		workers[i].join();
+	}
+	workers.clear();
+	queues.clear();
+}
+
+int JobSystem::currentSlot() const
+{
+	// Threads outside the pool share the first deque
+	return slotOwner == this ? slotIndex : 0;
+}
+
+void JobSystem::run(JobCounter &counter, const std::function<void()> &job)
+{
+	counter.pending++;
+	if (queues.empty()) {
+		job();
+		counter.pending--;
+		return;
+	}
+
+	Job queued;
+	queued.function = job;
+	queued.counter = &counter;
+	push(currentSlot(), queued);
+
+	// Counted before the sleepers check, so a worker cannot miss it and go back to sleep
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+	}
+	wake.notify_one();
+}
+
+void JobSystem::wait(JobCounter &counter)
+{
+	int slot = currentSlot();
+	while (counter.pending > 0) {
+		Job job;
+		if (pop(slot, job)) {
+			execute(job);
+		} else {
+			// The last jobs are running elsewhere
+			std::this_thread::yield();
+		}
+	}
+}
+
+void JobSystem::parallelFor(int count, int grain, const std::function<void(int, int)> &task)
+{
+	grain = std::max(grain, 1);
+	if (threadCount() <= 1 || count <= grain) {
+		task(0, count);
+		return;
+	}
+
+	// A few chunks per thread leaves room to balance uneven chunks by stealing
+	int chunks = std::min((count + grain - 1) / grain, threadCount() * 4);
+	JobCounter counter;
+	counter.pending += chunks;
+	int slot = currentSlot();
+	for (int chunk = 0; chunk < chunks; ++chunk) {
+		int begin = int(int64_t(count) * chunk / chunks);
+		int end = int(int64_t(count) * (chunk + 1) / chunks);
+		Job job;
+		job.function = [&task, begin, end]() { task(begin, end); };
+		job.counter = &counter;
+		push(slot, job);
+	}
+	{
+		std::lock_guard<std::mutex> lock(sleepMutex);
+	}
+	wake.notify_all();
+
+	wait(counter);
+}
+
+void JobSystem::push(int slot, const Job &job)
+{
+	WorkerQueue &queue = *queues[slot];
+	{
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.jobs.push_back(job);
+	}
+	queuedJobs++;
+}
+
+bool JobSystem::pop(int slot, Job &job)
+{
+	// Own deque first, newest job
+	{
+		WorkerQueue &queue = *queues[slot];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.jobs.empty()) {
+			job = std::move(queue.jobs.back());
+			queue.jobs.pop_back();
+			queuedJobs--;
+			return true;
+		}
+	}
+
+	// Then steal the oldest job of the next thread that has one
+	int count = threadCount();
+	for (int i = 1; i < count; ++i) {
+		WorkerQueue &queue = *queues[(slot + i) % count];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		if (!queue.jobs.empty()) {
+			job = std::move(queue.jobs.front());
+			queue.jobs.pop_front();
+			queuedJobs--;
+			return true;
+		}
+	}
+	return false;
+}
+
+void JobSystem::execute(Job &job)
+{
+	job.function();
+	job.counter->pending--;
+}
+
+void JobSystem::workerLoop(int slot)
+{
+	slotOwner = this;
+	slotIndex = slot;
+	for (;;) {
+		Job job;
+		if (pop(slot, job)) {
+			execute(job);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(sleepMutex);
+		wake.wait(lock, [this] { return quit || queuedJobs > 0; });
+		if (quit) {
+			return;
+		}
+	}
+}
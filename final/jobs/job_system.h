@@ -0,0 +1,71 @@
+#ifndef _JOB_SYSTEM_H_
+#define _JOB_SYSTEM_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Jobs of one group still to finish; wait() on it to join them
+struct JobCounter {
+	std::atomic<int> pending;
+
+	JobCounter() : pending(0) {}
+};
+
+// Work-stealing scheduler for the frame's CPU work. Every thread owns a deque:
+// it pushes and pops its own jobs at the back, so freshly split work stays in
+// its cache, and an idle thread steals the oldest job from the front of
+// another's. The thread that calls initialize() is slot 0 and runs jobs
+// whenever it waits, so jobs may spawn and wait on jobs of their own.
+class JobSystem
+{
+public:
+	JobSystem();
+	~JobSystem();
+
+	// threadCount includes the calling thread, 0 picks the hardware concurrency
+	void initialize(int threadCount);
+	void cleanup();
+
+	int threadCount() const { return int(queues.size()); }
+
+	// Queues job on the calling thread's deque and counts it in counter
+	void run(JobCounter &counter, const std::function<void()> &job);
+
+	// Runs queued jobs until everything counted in counter has finished
+	void wait(JobCounter &counter);
+
+	// task(begin, end) over [0, count) in chunks of at least grain items; returns when all are done
+	void parallelFor(int count, int grain, const std::function<void(int, int)> &task);
+
+private:
+	struct Job {
+		std::function<void()> function;
+		JobCounter *counter;
+	};
+
+	struct WorkerQueue {
+		std::mutex mutex;
+		std::deque<Job> jobs;
+	};
+
+	int currentSlot() const;
+	void push(int slot, const Job &job);
+	bool pop(int slot, Job &job);
+	void execute(Job &job);
+	void workerLoop(int slot);
+
+	std::vector<std::unique_ptr<WorkerQueue>> queues;
+	std::vector<std::thread> workers;
+	std::mutex sleepMutex;
+	std::condition_variable wake;
+	std::atomic<int> queuedJobs;
+	std::atomic<bool> quit;
+};
+
+#endif
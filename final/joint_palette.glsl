@@ -0,0 +1,11 @@
+// Joint matrices as the CPU stores them with storeJointRows(): three texels per
+// joint, the rows of a 3x4 affine matrix
+mat4 jointRowsMatrix(vec4 r0, vec4 r1, vec4 r2) {
+    return mat4(vec4(r0.x, r1.x, r2.x, 0.0), vec4(r0.y, r1.y, r2.y, 0.0),
+                vec4(r0.z, r1.z, r2.z, 0.0), vec4(r0.w, r1.w, r2.w, 1.0));
+}
+
+// Joint matrix whose rows start at texel in a palette buffer
+mat4 paletteJointMatrix(samplerBuffer palette, int texel) {
+    return jointRowsMatrix(texelFetch(palette, texel), texelFetch(palette, texel + 1), texelFetch(palette, texel + 2));
+}
@@ -0,0 +1,102 @@
+#include "ocean_clipmap.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+void OceanClipmap::initialize(const ClipmapParameters &parameters)
+{
+	params = parameters;
+	params.blockSize += params.blockSize & 1;
+	params.levels = std::max(1, std::min(params.levels, maxClipmapLevels));
+
+	// The camera sits at most half a coarse cell from the clipmap centre, so
+	// morphing finishes that far inside each level's outer edge and starts that
+	// far outside its inner edge. Both edges then match their neighbours exactly.
+	float coarsest = params.baseSpacing * float(1 << (params.levels - 1));
+	float slack = 0.5f * coarsest;
+
+	levelData.resize(params.levels);
+	for (int l = 0; l < params.levels; ++l) {
+		ClipmapLevel &level = levelData[l];
+		level.spacing = params.baseSpacing * float(1 << l);
+
+		float outer = 2.0f * params.blockSize * level.spacing;
+		float inner = l > 0 ? 0.5f * outer : 0.0f;
+		level.morphRange = glm::vec2(inner + slack, outer - slack);
+		if (l == params.levels - 1 || level.morphRange.x >= level.morphRange.y) {
+			level.morphRange = glm::vec2(FLT_MAX * 0.5f, FLT_MAX);	// Outermost level never morphs
+		}
+	}
+
+	// Even so the outermost level stays centred and its hole stays 2x2 blocks
+	float outerBlockWidth = params.blockSize * levelData.back().spacing;
+	outerBlocks = 2 * std::max(2, int(std::ceil(params.viewDistance / outerBlockWidth)));
+	blockList.reserve(16 + 12 * (params.levels - 2) + outerBlocks * outerBlocks - 4);
+}
+
+void OceanClipmap::update(const glm::vec3 &cameraPosition)
+{
+	float coarsest = levelData.back().spacing;
+	glm::vec2 centre(std::floor(cameraPosition.x / coarsest + 0.5f) * coarsest,
+					 std::floor(cameraPosition.z / coarsest + 0.5f) * coarsest);
+
+	blockList.clear();
+	for (int l = 0; l < params.levels; ++l) {
+		int side = l == params.levels - 1 ? outerBlocks : 4;
+		int half = side / 2;
+		float blockWidth = params.blockSize * levelData[l].spacing;
+		glm::vec2 origin = centre - glm::vec2(half * blockWidth);
+
+		for (int z = 0; z < side; ++z) {
+			for (int x = 0; x < side; ++x) {
+				// The middle 2x2 blocks are covered by the finer level
+				bool inner = x >= half - 1 && x <= half && z >= half - 1 && z <= half;
+				if (l > 0 && inner) {
+					continue;
+				}
+
+				ClipmapBlock block;
+				block.offset = origin + glm::vec2(float(x), float(z)) * blockWidth;
+				block.level = l;
+				blockList.push_back(block);
+			}
+		}
+	}
+}
+
+void OceanClipmap::cull(const Frustum &frustum, float minHeight, float maxHeight, float horizontalMargin, std::vector<glm::vec4> &instances) const
+{
+	instances.clear();
+	for (const ClipmapBlock &block : blockList) {
+		float blockWidth = params.blockSize * levelData[block.level].spacing;
+		glm::vec3 boxMin(block.offset.x - horizontalMargin, minHeight, block.offset.y - horizontalMargin);
+		glm::vec3 boxMax(block.offset.x + blockWidth + horizontalMargin, maxHeight, block.offset.y + blockWidth + horizontalMargin);
+		if (frustum.intersectsBox(boxMin, boxMax)) {
+			instances.push_back(glm::vec4(block.offset, float(block.level), 0.0f));
+		}
+	}
+}
+
+float OceanClipmap::extent() const
+{
+	return 0.5f * outerBlocks * params.blockSize * levelData.back().spacing;
+}
+
+void buildClipmapBlockStrips(int blockSize, unsigned short restartIndex, std::vector<unsigned short> &indices)
+{
+	int side = blockSize + 1;
+	indices.clear();
+	indices.reserve(blockSize * (2 * side + 1));
+
+	// Same winding as the old triangle list: (x, z), (x, z + 1), (x + 1, z), ...
+	for (int z = 0; z < blockSize; ++z) {
+		for (int x = 0; x < side; ++x) {
+			indices.push_back((unsigned short)(z * side + x));
+			indices.push_back((unsigned short)((z + 1) * side + x));
+		}
+		if (z + 1 < blockSize) {
+			indices.push_back(restartIndex);
+		}
+	}
+}
@@ -0,0 +1,69 @@
+#ifndef _OCEAN_CLIPMAP_H_
+#define _OCEAN_CLIPMAP_H_
+
+#include <glm/glm.hpp>
+#include <render/frustum.h>
+
+#include <vector>
+
+// Must match MAX_CLIPMAP_LEVELS in water.vert
+static const int maxClipmapLevels = 8;
+
+struct ClipmapParameters {
+	int levels;                 // Nested rings, each with twice the spacing of the one inside it
+	int blockSize;              // Cells along a block edge, must be even
+	float baseSpacing;          // Vertex spacing of the innermost level
+	float viewDistance;         // The outermost level gains block rings until it reaches this far
+
+	ClipmapParameters() : levels(5), blockSize(16), baseSpacing(1.0f), viewDistance(0.0f) {}
+};
+
+struct ClipmapLevel {
+	float spacing;
+	glm::vec2 morphRange;       // Chebyshev distance from the camera where odd vertices start/finish collapsing
+};
+
+// One blockSize x blockSize patch of a level, all levels reuse the same block mesh.
+// Blocks are world-anchored tiles: their vertices sit on the level's lattice.
+struct ClipmapBlock {
+	glm::vec2 offset;           // World xz of the block's first vertex
+	int level;
+};
+
+// Camera-centred geometry clipmap.
+// Level 0 is a 4x4 grid of blocks; every coarser level is a ring of 12 blocks
+// around the level inside it, and the outermost ring keeps growing to the view
+// distance. All levels are centred on the camera snapped to
+// the coarsest spacing, so every vertex stays on its level's lattice as the
+// camera moves. Near the outer edge of a level its odd vertices morph onto the
+// next level's lattice, which closes the T-junctions between rings.
+class OceanClipmap
+{
+public:
+	void initialize(const ClipmapParameters &parameters);
+	void update(const glm::vec3 &cameraPosition);
+
+	// Blocks whose bounds, padded to [minHeight, maxHeight] and by horizontalMargin in x/z, touch the frustum.
+	// One instance per block: (offset.x, offset.y, level, 0).
+	void cull(const Frustum &frustum, float minHeight, float maxHeight, float horizontalMargin, std::vector<glm::vec4> &instances) const;
+
+	const ClipmapParameters &parameters() const { return params; }
+	const std::vector<ClipmapLevel> &levels() const { return levelData; }
+	const std::vector<ClipmapBlock> &blocks() const { return blockList; }
+
+	// Half-width of the area covered by the outermost level
+	float extent() const;
+
+private:
+	ClipmapParameters params;
+	std::vector<ClipmapLevel> levelData;
+	std::vector<ClipmapBlock> blockList;
+	int outerBlocks;            // Blocks along each side of the outermost level
+};
+
+// Triangle strip over one block, one strip per row separated by restartIndex.
+// Indices are vertex ids; the vertex shader decodes x = id % (blockSize + 1),
+// z = id / (blockSize + 1), so the block needs no vertex buffer.
+void buildClipmapBlockStrips(int blockSize, unsigned short restartIndex, std::vector<unsigned short> &indices);
+
+#endif
@@ -0,0 +1,475 @@
+#include "ocean_fft.h"
+
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <random>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define OCEAN_SIMD_SSE
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define OCEAN_SIMD_NEON
+#endif
+
+static const float kGravity = 9.81f;
+static const double kPi = 3.14159265358979323846;
+
+// Where crests fold over the slope correction would divide by ~0; keep the same limit as ocean_resolve.frag
+static const float minSlopeStretch = 0.25f;
+
+// Four-wide float helpers, so the butterflies read the same on SSE, NEON and scalar builds
+namespace {
+#if defined(OCEAN_SIMD_SSE)
+	typedef __m128 float4;
+	inline float4 load4(const float *p) { return _mm_loadu_ps(p); }
+	inline void store4(float *p, float4 v) { _mm_storeu_ps(p, v); }
+	inline float4 splat4(float v) { return _mm_set1_ps(v); }
+	inline float4 add4(float4 a, float4 b) { return _mm_add_ps(a, b); }
+	inline float4 sub4(float4 a, float4 b) { return _mm_sub_ps(a, b); }
+	inline float4 mul4(float4 a, float4 b) { return _mm_mul_ps(a, b); }
+#elif defined(OCEAN_SIMD_NEON)
+	typedef float32x4_t float4;
+	inline float4 load4(const float *p) { return vld1q_f32(p); }
+	inline void store4(float *p, float4 v) { vst1q_f32(p, v); }
+	inline float4 splat4(float v) { return vdupq_n_f32(v); }
+	inline float4 add4(float4 a, float4 b) { return vaddq_f32(a, b); }
+	inline float4 sub4(float4 a, float4 b) { return vsubq_f32(a, b); }
+	inline float4 mul4(float4 a, float4 b) { return vmulq_f32(a, b); }
+#else
+	struct float4 { float v[4]; };
+	inline float4 load4(const float *p) { float4 r; for (int i = 0; i < 4; ++i) r.v[i] = p[i]; return r; }
+	inline void store4(float *p, float4 a) { for (int i = 0; i < 4; ++i) p[i] = a.v[i]; }
+	inline float4 splat4(float s) { float4 r; for (int i = 0; i < 4; ++i) r.v[i] = s; return r; }
+	inline float4 add4(float4 a, float4 b) { for (int i = 0; i < 4; ++i) a.v[i] += b.v[i]; return a; }
+	inline float4 sub4(float4 a, float4 b) { for (int i = 0; i < 4; ++i) a.v[i] -= b.v[i]; return a; }
+	inline float4 mul4(float4 a, float4 b) { for (int i = 0; i < 4; ++i) a.v[i] *= b.v[i]; return a; }
+#endif
+
+	// (aRe, aIm) +/- (bRe, bIm) * (wRe, wIm), written back in place
+	inline void butterfly4(float *aRe, float *aIm, float *bRe, float *bIm, float4 wr, float4 wi)
+	{
+		float4 ar = load4(aRe), ai = load4(aIm);
+		float4 br = load4(bRe), bi = load4(bIm);
+		float4 tr = sub4(mul4(br, wr), mul4(bi, wi));
+		float4 ti = add4(mul4(br, wi), mul4(bi, wr));
+		store4(aRe, add4(ar, tr));
+		store4(aIm, add4(ai, ti));
+		store4(bRe, sub4(ar, tr));
+		store4(bIm, sub4(ai, ti));
+	}
+
+	inline void butterfly1(float &aRe, float &aIm, float &bRe, float &bIm, float wr, float wi)
+	{
+		float tr = bRe * wr - bIm * wi;
+		float ti = bRe * wi + bIm * wr;
+		bRe = aRe - tr;
+		bIm = aIm - ti;
+		aRe += tr;
+		aIm += ti;
+	}
+}
+
+OceanFFT::OceanFFT()
+	: N(0), logN(0), jobs(nullptr)
+{
+}
+
+OceanFFT::~OceanFFT()
+{
+	cleanup();
+}
+
+void OceanFFT::initialize(const OceanParameters &parameters, JobSystem *jobs)
+{
+	cleanup();
+
+	this->jobs = jobs;
+	params = parameters;
+	N = params.size;
+	if (N < 4 || (N & (N - 1)) != 0) {
+		std::cerr << "Ocean grid size must be a power of two >= 4, got " << N << std::endl;
+		N = 256;
+	}
+	logN = 0;
+	while ((1 << logN) < N) ++logN;
+
+	// Bit reversal permutation
+	bitReverse.resize(N);
+	for (int i = 0; i < N; ++i) {
+		int r = 0;
+		for (int b = 0; b < logN; ++b) {
+			if (i & (1 << b)) r |= 1 << (logN - 1 - b);
+		}
+		bitReverse[i] = r;
+	}
+
+	// Inverse transform twiddles e^{+i*pi*j/h}, one block per stage
+	twiddleRe.assign(N, 0.0f);
+	twiddleIm.assign(N, 0.0f);
+	for (int half = 1; half < N; half <<= 1) {
+		for (int j = 0; j < half; ++j) {
+			double angle = kPi * double(j) / double(half);
+			twiddleRe[half + j] = float(cos(angle));
+			twiddleIm[half + j] = float(sin(angle));
+		}
+	}
+
+	workRe.assign(transformCount * N * N, 0.0f);
+	workIm.assign(transformCount * N * N, 0.0f);
+	packedField.assign(oceanMapLayers * N * N * 4, 0.0f);
+
+	generateSpectrum();
+}
+
+void OceanFFT::cleanup()
+{
+	jobs = nullptr;
+}
+
+float OceanFFT::dispersion(const glm::vec2 &k)
+{
+	return sqrtf(kGravity * glm::length(k));
+}
+
+float OceanFFT::spectrumDensity(const glm::vec2 &k) const
+{
+	float k2 = glm::dot(k, k);
+	if (k2 < 1e-12f) {
+		return 0.0f;
+	}
+	float kLength = sqrtf(k2);
+	glm::vec2 wind = glm::normalize(params.windDirection);
+	float cosTheta = glm::dot(k / kLength, wind);
+
+	float density = 0.0f;
+	if (params.spectrum == OCEAN_SPECTRUM_PHILLIPS) {
+		// Phillips spectrum, waves travelling against the wind are damped
+		float L = params.windSpeed * params.windSpeed / kGravity;
+		density = params.amplitude * expf(-1.0f / (k2 * L * L)) / (k2 * k2) * cosTheta * cosTheta;
+		if (cosTheta < 0.0f) {
+			density *= 0.07f;
+		}
+	} else {
+		// JONSWAP frequency spectrum mapped to wave numbers with a cos^2 spreading function
+		float w = dispersion(k);
+		float U = params.windSpeed;
+		float F = params.fetch;
+		float wp = 22.0f * powf(kGravity * kGravity / (U * F), 1.0f / 3.0f);
+		float alpha = 0.076f * powf(U * U / (F * kGravity), 0.22f);
+		float sigma = w <= wp ? 0.07f : 0.09f;
+		float r = expf(-(w - wp) * (w - wp) / (2.0f * sigma * sigma * wp * wp));
+		float S = alpha * kGravity * kGravity / powf(w, 5.0f)
+				* expf(-1.25f * powf(wp / w, 4.0f)) * powf(params.peakEnhancement, r);
+
+		float spreading = cosTheta > 0.0f ? float(2.0 / kPi) * cosTheta * cosTheta : 0.0f;
+		float dwdk = kGravity / (2.0f * w);
+		density = params.amplitude * S * dwdk / kLength * spreading;
+	}
+
+	// Remove very short waves that the grid cannot resolve anyway
+	float l = params.smallWaveCutoff;
+	return density * expf(-k2 * l * l);
+}
+
+void OceanFFT::generateSpectrum()
+{
+	int count = N * N;
+	h0Re.assign(count, 0.0f);
+	h0Im.assign(count, 0.0f);
+	h0ConjRe.assign(count, 0.0f);
+	h0ConjIm.assign(count, 0.0f);
+	omega.assign(count, 0.0f);
+
+	// Box-Muller on raw mt19937 output keeps the spectrum identical across standard libraries
+	std::mt19937 rng(params.seed);
+	const double inv = 1.0 / 4294967296.0;
+	float dk = float(2.0 * kPi) / params.patchLength;
+
+	for (int y = 0; y < N; ++y) {
+		for (int x = 0; x < N; ++x) {
+			glm::vec2 k(dk * float(x - N / 2), dk * float(y - N / 2));
+			int i = y * N + x;
+
+			double u1 = (double(rng()) + 1.0) * inv;
+			double u2 = double(rng()) * inv;
+			double radius = sqrt(-2.0 * log(u1));
+			float gaussRe = float(radius * cos(2.0 * kPi * u2));
+			float gaussIm = float(radius * sin(2.0 * kPi * u2));
+
+			float amplitude = sqrtf(spectrumDensity(k) * dk * dk * 0.5f);
+			h0Re[i] = gaussRe * amplitude;
+			h0Im[i] = gaussIm * amplitude;
+			omega[i] = dispersion(k);
+		}
+	}
+
+	// conj(h0(-k)); index n maps to wave number n - N/2, so -k lives at (N - n) mod N
+	for (int y = 0; y < N; ++y) {
+		for (int x = 0; x < N; ++x) {
+			int mirrored = ((N - y) % N) * N + (N - x) % N;
+			h0ConjRe[y * N + x] = h0Re[mirrored];
+			h0ConjIm[y * N + x] = -h0Im[mirrored];
+		}
+	}
+}
+
+void OceanFFT::packSpectrum(std::vector<float> &rgba) const
+{
+	rgba.resize(size_t(N) * N * 4);
+	for (int i = 0; i < N * N; ++i) {
+		rgba[4 * i + 0] = h0Re[i];
+		rgba[4 * i + 1] = h0Im[i];
+		rgba[4 * i + 2] = h0ConjRe[i];
+		rgba[4 * i + 3] = h0ConjIm[i];
+	}
+}
+
+void OceanFFT::evolveSpectrum(float time, int rowBegin, int rowEnd)
+{
+	float dk = float(2.0 * kPi) / params.patchLength;
+	int plane = N * N;
+	float *re = workRe.data();
+	float *im = workIm.data();
+
+	for (int i = rowBegin * N; i < rowEnd * N; ++i) {
+		float c = cosf(omega[i] * time);
+		float s = sinf(omega[i] * time);
+
+		// h(k, t) = h0(k) e^{iwt} + conj(h0(-k)) e^{-iwt}
+		float hRe = (h0Re[i] + h0ConjRe[i]) * c - (h0Im[i] - h0ConjIm[i]) * s;
+		float hIm = (h0Im[i] + h0ConjIm[i]) * c + (h0Re[i] - h0ConjRe[i]) * s;
+
+		float kx = dk * float(i % N - N / 2);
+		float kz = dk * float(i / N - N / 2);
+		float kLength = sqrtf(kx * kx + kz * kz);
+		float invK = kLength > 1e-6f ? 1.0f / kLength : 0.0f;
+
+		// Displacement i k/|k| h (towards the crests), slope i k h, displacement derivatives -k k/|k| h
+		float dxRe = -kx * invK * hIm, dxIm = kx * invK * hRe;
+		float dzRe = -kz * invK * hIm, dzIm = kz * invK * hRe;
+		float sxRe = -kx * hIm, sxIm = kx * hRe;
+		float szRe = -kz * hIm, szIm = kz * hRe;
+		float dxxRe = -kx * kx * invK * hRe, dxxIm = -kx * kx * invK * hIm;
+		float dzzRe = -kz * kz * invK * hRe, dzzIm = -kz * kz * invK * hIm;
+		float dxzRe = -kx * kz * invK * hRe, dxzIm = -kx * kz * invK * hIm;
+
+		// Pairs a + i b, the transforms come back as (a, b): (Dx, Dz), (h, sx), (sz, dDx/dx), (dDz/dz, dDx/dz)
+		re[i] = dxRe - dzIm;                 im[i] = dxIm + dzRe;
+		re[plane + i] = hRe - sxIm;          im[plane + i] = hIm + sxRe;
+		re[2 * plane + i] = szRe - dxxIm;    im[2 * plane + i] = szIm + dxxRe;
+		re[3 * plane + i] = dzzRe - dxzIm;   im[3 * plane + i] = dzzIm + dxzRe;
+	}
+}
+
+void OceanFFT::inverseFFTRow(float *re, float *im) const
+{
+	for (int i = 0; i < N; ++i) {
+		int j = bitReverse[i];
+		if (i < j) {
+			std::swap(re[i], re[j]);
+			std::swap(im[i], im[j]);
+		}
+	}
+
+	for (int half = 1; half < N; half <<= 1) {
+		const float *wr = &twiddleRe[half];
+		const float *wi = &twiddleIm[half];
+		for (int start = 0; start < N; start += 2 * half) {
+			float *aRe = re + start, *aIm = im + start;
+			float *bRe = aRe + half, *bIm = aIm + half;
+			if (half < 4) {
+				for (int j = 0; j < half; ++j) {
+					butterfly1(aRe[j], aIm[j], bRe[j], bIm[j], wr[j], wi[j]);
+				}
+			} else {
+				for (int j = 0; j < half; j += 4) {
+					butterfly4(aRe + j, aIm + j, bRe + j, bIm + j, load4(wr + j), load4(wi + j));
+				}
+			}
+		}
+	}
+}
+
+void OceanFFT::transformRows(int rowBegin, int rowEnd)
+{
+	for (int t = 0; t < transformCount; ++t) {
+		for (int y = rowBegin; y < rowEnd; ++y) {
+			int row = (t * N + y) * N;
+			inverseFFTRow(&workRe[row], &workIm[row]);
+		}
+	}
+}
+
+void OceanFFT::transformColumns(int columnBegin, int columnEnd)
+{
+	for (int t = 0; t < transformCount; ++t) {
+		transformColumns(workRe.data() + t * N * N, workIm.data() + t * N * N, columnBegin, columnEnd);
+	}
+}
+
+void OceanFFT::transformColumns(float *re, float *im, int columnBegin, int columnEnd)
+{
+	// Runs the column transforms side by side: every butterfly combines two row
+	// segments, so the SIMD lanes walk along x with a broadcast twiddle.
+	int width = columnEnd - columnBegin;
+
+	for (int i = 0; i < N; ++i) {
+		int j = bitReverse[i];
+		if (i < j) {
+			std::swap_ranges(re + i * N + columnBegin, re + i * N + columnEnd, re + j * N + columnBegin);
+			std::swap_ranges(im + i * N + columnBegin, im + i * N + columnEnd, im + j * N + columnBegin);
+		}
+	}
+
+	for (int half = 1; half < N; half <<= 1) {
+		for (int start = 0; start < N; start += 2 * half) {
+			for (int j = 0; j < half; ++j) {
+				float wr = twiddleRe[half + j];
+				float wi = twiddleIm[half + j];
+				float4 wr4 = splat4(wr), wi4 = splat4(wi);
+				float *aRe = re + (start + j) * N + columnBegin;
+				float *aIm = im + (start + j) * N + columnBegin;
+				float *bRe = aRe + half * N;
+				float *bIm = aIm + half * N;
+
+				int x = 0;
+				for (; x + 4 <= width; x += 4) {
+					butterfly4(aRe + x, aIm + x, bRe + x, bIm + x, wr4, wi4);
+				}
+				for (; x < width; ++x) {
+					butterfly1(aRe[x], aIm[x], bRe[x], bIm[x], wr, wi);
+				}
+			}
+		}
+	}
+}
+
+void OceanFFT::resolveTexel(int x, int y, float *displacement, float *slope) const
+{
+	int plane = N * N;
+	int i = y * N + x;
+	float lambda = params.choppiness;
+
+	// Undo the half-grid shift of the wave numbers: multiply by (-1)^(x + y)
+	float sign = ((x + y) & 1) ? -1.0f : 1.0f;
+	float dx = sign * workRe[i], dz = sign * workIm[i];
+	float h = sign * workRe[plane + i], sx = sign * workIm[plane + i];
+	float sz = sign * workRe[2 * plane + i], dxx = sign * workIm[2 * plane + i];
+	float dzz = sign * workRe[3 * plane + i], dxz = sign * workIm[3 * plane + i];
+
+	// Partial derivatives of the displaced position along x and z
+	float jx = 1.0f + lambda * dxx;
+	float jz = 1.0f + lambda * dzz;
+	float jacobian = jx * jz - lambda * lambda * dxz * dxz;
+
+	displacement[0] = lambda * dx;
+	displacement[1] = h;
+	displacement[2] = lambda * dz;
+	displacement[3] = 0.0f;
+
+	slope[0] = sx / std::max(jx, minSlopeStretch);
+	slope[1] = sz / std::max(jz, minSlopeStretch);
+	slope[2] = jacobian;
+	slope[3] = 0.0f;
+}
+
+void OceanFFT::resolveMap(int rowBegin, int rowEnd, float *destination)
+{
+	int plane = N * N;
+	for (int y = rowBegin; y < rowEnd; ++y) {
+		for (int x = 0; x < N; ++x) {
+			int i = y * N + x;
+			resolveTexel(x, y, destination + 4 * i, destination + 4 * (plane + i));
+		}
+	}
+}
+
+void OceanFFT::resolveMap(int rowBegin, int rowEnd, uint16_t *destination)
+{
+	int plane = N * N;
+	float displacement[4], slope[4];
+	for (int y = rowBegin; y < rowEnd; ++y) {
+		for (int x = 0; x < N; ++x) {
+			int i = y * N + x;
+			resolveTexel(x, y, displacement, slope);
+			uint16_t *displacementTexel = destination + 4 * i;
+			uint16_t *slopeTexel = destination + 4 * (plane + i);
+			for (int c = 0; c < 4; ++c) {
+				displacementTexel[c] = uint16_t(glm::packHalf1x16(displacement[c]));
+				slopeTexel[c] = uint16_t(glm::packHalf1x16(slope[c]));
+			}
+		}
+	}
+}
+
+void OceanFFT::update(float time)
+{
+	update(time, packedField.data());
+}
+
+void OceanFFT::update(float time, float *destination)
+{
+	if (N == 0) {
+		return;
+	}
+	transform(time);
+	parallelFor(N, [this, destination](int begin, int end) { resolveMap(begin, end, destination); });
+}
+
+void OceanFFT::update(float time, uint16_t *destination)
+{
+	if (N == 0) {
+		return;
+	}
+	transform(time);
+	parallelFor(N, [this, destination](int begin, int end) { resolveMap(begin, end, destination); });
+}
+
+void OceanFFT::transform(float time)
+{
+	parallelFor(N, [this, time](int begin, int end) { evolveSpectrum(time, begin, end); });
+	parallelFor(N, [this](int begin, int end) { transformRows(begin, end); });
+
+	// Columns are handed out in groups of four to keep whole SIMD lanes per worker
+	int groups = N / 4;
+	parallelFor(groups, [this](int begin, int end) { transformColumns(begin * 4, end * 4); });
+}
+
+void OceanFFT::parallelFor(int count, const std::function<void(int, int)> &task)
+{
+	if (!jobs) {
+		task(0, count);
+		return;
+	}
+	jobs->parallelFor(count, 1, task);
+}
+
+void buildStockhamButterflies(int N, std::vector<float> &rgba)
+{
+	int stages = 0;
+	while ((1 << stages) < N) ++stages;
+	rgba.resize(size_t(N) * stages * 4);
+
+	for (int stage = 0; stage < stages; ++stage) {
+		int span = 1 << stage;
+		for (int i = 0; i < N; ++i) {
+			// Output i is the upper or lower half of the butterfly on source j and j + N/2
+			int m = i % (2 * span);
+			int k = m % span;
+			int j = (i / (2 * span)) * span + k;
+			double angle = kPi * double(k) / double(span);
+			float sign = m < span ? 1.0f : -1.0f;
+
+			float *texel = &rgba[(size_t(stage) * N + i) * 4];
+			texel[0] = sign * float(cos(angle));
+			texel[1] = sign * float(sin(angle));
+			texel[2] = float(j);
+			texel[3] = float(j + N / 2);
+		}
+	}
+}
@@ -0,0 +1,121 @@
+#ifndef _OCEAN_FFT_H_
+#define _OCEAN_FFT_H_
+
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "jobs/job_system.h"
+
+// Wave spectrum used to build the initial amplitudes h0(k)
+enum OceanSpectrumType {
+	OCEAN_SPECTRUM_PHILLIPS,
+	OCEAN_SPECTRUM_JONSWAP
+};
+
+struct OceanParameters {
+	int size;                   // Grid resolution N, must be a power of two
+	float patchLength;          // World-space extent of one tile
+	float windSpeed;            // Wind speed at 10m (m/s)
+	glm::vec2 windDirection;
+	float amplitude;            // Phillips constant A, scale factor for JONSWAP
+	float fetch;                // JONSWAP fetch length (m)
+	float peakEnhancement;      // JONSWAP gamma
+	float smallWaveCutoff;      // Suppresses waves shorter than this (m)
+	float choppiness;           // Horizontal displacement scale lambda, 0 gives plain heightfield waves
+	OceanSpectrumType spectrum;
+	unsigned int seed;
+
+	OceanParameters()
+		: size(256), patchLength(256.0f), windSpeed(12.0f), windDirection(1.0f, 0.6f),
+		  amplitude(1.0f), fetch(120000.0f), peakEnhancement(3.3f), smallWaveCutoff(0.5f),
+		  choppiness(1.0f), spectrum(OCEAN_SPECTRUM_JONSWAP), seed(1337u) {}
+};
+
+// Layers of the packed ocean map, RGBA per texel:
+//   0: choppy displacement x, height, choppy displacement z, unused
+//   1: slope x, slope z (both corrected for the horizontal displacement), Jacobian, unused
+static const int oceanMapLayers = 2;
+
+// CPU reference implementation of Tessendorf's FFT ocean.
+// The spectrum h0(k) is generated once; update() evolves it to time t and runs
+// the inverse FFTs (SIMD butterflies, rows and columns split into jobs).
+// Eight real fields are packed two per complex transform, since each is the
+// transform of a Hermitian spectrum. The result is laid out like the GPU map.
+class OceanFFT
+{
+public:
+	OceanFFT();
+	~OceanFFT();
+
+	// Without a job system every pass runs on the calling thread
+	void initialize(const OceanParameters &parameters, JobSystem *jobs = nullptr);
+	void update(float time);
+	void cleanup();
+
+	int size() const { return N; }
+	const OceanParameters &parameters() const { return params; }
+
+	// Same, but resolves the map straight into caller memory such as a mapped PBO
+	void update(float time, float *destination);
+
+	// Same layout as half floats, ready for glTexSubImage3D(GL_RGBA, GL_HALF_FLOAT)
+	// into the RGBA16F map without a conversion in the driver
+	void update(float time, uint16_t *destination);
+
+	// Layer-major RGBA map, oceanMapLayers * N * N * 4 floats, ready for glTexSubImage3D(GL_RGBA, GL_FLOAT)
+	const float *packedMap() const { return packedField.data(); }
+
+	// h0(k) and conj(h0(-k)) packed as RGBA per texel, for the GPU spectrum pass
+	void packSpectrum(std::vector<float> &rgba) const;
+
+	// Angular frequency of wave vector k (deep water dispersion)
+	static float dispersion(const glm::vec2 &k);
+
+	// In-place inverse FFT of one row of split real/imaginary data
+	void inverseFFTRow(float *re, float *im) const;
+
+private:
+	void generateSpectrum();
+	float spectrumDensity(const glm::vec2 &k) const;
+
+	void evolveSpectrum(float time, int rowBegin, int rowEnd);
+	void transformRows(int rowBegin, int rowEnd);
+	void transformColumns(int columnBegin, int columnEnd);
+	void transformColumns(float *re, float *im, int columnBegin, int columnEnd);
+	void transform(float time);
+	void resolveTexel(int x, int y, float *displacement, float *slope) const;
+	void resolveMap(int rowBegin, int rowEnd, float *destination);
+	void resolveMap(int rowBegin, int rowEnd, uint16_t *destination);
+
+	void parallelFor(int count, const std::function<void(int, int)> &task);
+
+	OceanParameters params;
+	int N;
+	int logN;
+
+	// Initial spectrum h0(k) and conj(h0(-k)), split into real/imaginary planes
+	std::vector<float> h0Re, h0Im;
+	std::vector<float> h0ConjRe, h0ConjIm;
+	std::vector<float> omega;
+
+	// Working buffers for the frequency-domain data and the 2D IFFTs, one N * N plane per transform
+	static const int transformCount = 4;
+	std::vector<float> workRe, workIm;
+	std::vector<float> packedField;
+
+	// Twiddles for the stage with half-size h live at [h, 2h)
+	std::vector<float> twiddleRe, twiddleIm;
+	std::vector<int> bitReverse;
+
+	JobSystem *jobs;
+};
+
+// Butterfly lookup table for a radix-2 Stockham inverse FFT of size N.
+// One RGBA texel per (output index, stage): twiddle (re, im) and the two
+// source indices, so pass output[i] = input[A] + twiddle * input[B].
+void buildStockhamButterflies(int N, std::vector<float> &rgba);
+
+#endif
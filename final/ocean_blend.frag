@@ -0,0 +1,19 @@
+#version 330 core
+
+uniform sampler2DArray previousMap;
+uniform sampler2DArray latestMap;
+uniform float blendFactor;
+
+layout(location = 0) out vec4 Displacement;
+layout(location = 1) out vec4 Slope;
+
+void main()
+{
+    ivec2 texelCoords = ivec2(gl_FragCoord.xy);
+
+    // Interpolate between the two newest simulation steps, both layers of the packed map
+    Displacement = mix(texelFetch(previousMap, ivec3(texelCoords, 0), 0),
+                       texelFetch(latestMap, ivec3(texelCoords, 0), 0), blendFactor);
+    Slope = mix(texelFetch(previousMap, ivec3(texelCoords, 1), 0),
+                texelFetch(latestMap, ivec3(texelCoords, 1), 0), blendFactor);
+}
@@ -0,0 +1,23 @@
+#version 330 core
+
+uniform sampler2D heightTexture;
+uniform float texelSpacing;
+
+layout(location = 0) out vec4 Displacement;
+layout(location = 1) out vec4 Slope;
+
+void main()
+{
+    ivec2 texelCoords = ivec2(gl_FragCoord.xy);
+    ivec2 size = textureSize(heightTexture, 0);
+
+    // The legacy passes only produce heights: no horizontal displacement, finite-difference slopes
+    float height = texelFetch(heightTexture, texelCoords, 0).r;
+    float heightLeft = texelFetch(heightTexture, ivec2((texelCoords.x + size.x - 1) % size.x, texelCoords.y), 0).r;
+    float heightRight = texelFetch(heightTexture, ivec2((texelCoords.x + 1) % size.x, texelCoords.y), 0).r;
+    float heightDown = texelFetch(heightTexture, ivec2(texelCoords.x, (texelCoords.y + size.y - 1) % size.y), 0).r;
+    float heightUp = texelFetch(heightTexture, ivec2(texelCoords.x, (texelCoords.y + 1) % size.y), 0).r;
+
+    Displacement = vec4(0.0, height, 0.0, 0.0);
+    Slope = vec4((heightRight - heightLeft) / (2.0 * texelSpacing), (heightUp - heightDown) / (2.0 * texelSpacing), 1.0, 0.0);
+}
@@ -0,0 +1,28 @@
+#version 330 core
+
+uniform sampler2DArray fftTexture;
+uniform float choppiness;
+
+layout(location = 0) out vec4 Displacement;   // Choppy x, height, choppy z
+layout(location = 1) out vec4 Slope;          // Slope x, slope z, Jacobian
+
+// Where crests fold over the slope correction would divide by ~0; same limit as the CPU engine
+const float minSlopeStretch = 0.25;
+
+void main()
+{
+    ivec2 texelCoords = ivec2(gl_FragCoord.xy);
+
+    // Real parts, with the (-1)^(x + y) term from centring the wave numbers
+    float parity = ((texelCoords.x + texelCoords.y) & 1) == 0 ? 1.0 : -1.0;
+    vec4 fields0 = parity * texelFetch(fftTexture, ivec3(texelCoords, 0), 0);   // Dx, Dz, h, slope x
+    vec4 fields1 = parity * texelFetch(fftTexture, ivec3(texelCoords, 1), 0);   // slope z, dDx/dx, dDz/dz, dDx/dz
+
+    // Partial derivatives of the displaced position along x and z
+    float jx = 1.0 + choppiness * fields1.y;
+    float jz = 1.0 + choppiness * fields1.z;
+    float jacobian = jx * jz - choppiness * choppiness * fields1.w * fields1.w;
+
+    Displacement = vec4(choppiness * fields0.x, fields0.z, choppiness * fields0.y, 0.0);
+    Slope = vec4(fields0.w / max(jx, minSlopeStretch), fields1.x / max(jz, minSlopeStretch), jacobian, 0.0);
+}
@@ -0,0 +1,42 @@
+#version 330 core
+
+uniform sampler2D spectrumTexture;   // h0(k).xy, conj(h0(-k)).zw
+uniform float patchLength;
+uniform float time;
+
+// Four complex spectra, two per layer; each pairs two real fields as a + i b
+layout(location = 0) out vec4 Spectrum0;   // (Dx + i Dz), (h + i slope x)
+layout(location = 1) out vec4 Spectrum1;   // (slope z + i dDx/dx), (dDz/dz + i dDx/dz)
+
+vec2 mulI(vec2 c) { return vec2(-c.y, c.x); }
+
+void main()
+{
+    ivec2 texelCoords = ivec2(gl_FragCoord.xy);
+    int N = textureSize(spectrumTexture, 0).x;
+    vec4 h0 = texelFetch(spectrumTexture, texelCoords, 0);
+
+    // Deep water dispersion
+    vec2 k = 6.28318530718 * vec2(texelCoords - ivec2(N / 2)) / patchLength;
+    float kLength = length(k);
+    float omega = sqrt(9.81 * kLength);
+    float c = cos(omega * time);
+    float s = sin(omega * time);
+
+    // h(k, t) = h0(k) e^{iwt} + conj(h0(-k)) e^{-iwt}
+    vec2 h = vec2((h0.x + h0.z) * c - (h0.y - h0.w) * s,
+                  (h0.y + h0.w) * c + (h0.x - h0.z) * s);
+
+    // Displacement i k/|k| h (towards the crests), slope i k h, displacement derivatives -k k/|k| h
+    vec2 kUnit = kLength > 1e-6 ? k / kLength : vec2(0.0);
+    vec2 dx = kUnit.x * mulI(h);
+    vec2 dz = kUnit.y * mulI(h);
+    vec2 sx = k.x * mulI(h);
+    vec2 sz = k.y * mulI(h);
+    vec2 dxx = -k.x * kUnit.x * h;
+    vec2 dzz = -k.y * kUnit.y * h;
+    vec2 dxz = -k.x * kUnit.y * h;
+
+    Spectrum0 = vec4(dx + mulI(dz), h + mulI(sx));
+    Spectrum1 = vec4(sz + mulI(dxx), dzz + mulI(dxz));
+}
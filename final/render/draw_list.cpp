@@ -0,0 +1,75 @@
+#include "draw_list.h"
+
+#include <cstddef>
+
+#define BUFFER_OFFSET(i) ((char *)NULL + (i))
+
+void DrawList::compile()
+{
+	batches.clear();
+	counts.clear();
+	offsets.clear();
+	baseVertices.clear();
+
+	for (size_t i = 0; i < records.size(); ++i) {
+		const DrawRecord &record = records[i];
+		if (batches.empty() || batches.back().vertexArrayID != record.vertexArrayID ||
+			batches.back().mode != record.mode || batches.back().indexType != record.indexType) {
+			Batch batch;
+			batch.vertexArrayID = record.vertexArrayID;
+			batch.mode = record.mode;
+			batch.indexType = record.indexType;
+			batch.first = int(counts.size());
+			batch.count = 0;
+			batches.push_back(batch);
+		}
+		batches.back().count++;
+		counts.push_back(record.count);
+		offsets.push_back(BUFFER_OFFSET(record.indexOffset));
+		baseVertices.push_back(record.baseVertex);
+	}
+}
+
+void DrawList::draw() const
+{
+	GLuint bound = 0;
+	for (size_t i = 0; i < batches.size(); ++i) {
+		const Batch &batch = batches[i];
+		if (batch.vertexArrayID != bound) {
+			glBindVertexArray(batch.vertexArrayID);
+			bound = batch.vertexArrayID;
+		}
+		if (batch.count == 1) {
+			glDrawElementsBaseVertex(batch.mode, counts[batch.first], batch.indexType,
+									 offsets[batch.first], baseVertices[batch.first]);
+		} else {
+			glMultiDrawElementsBaseVertex(batch.mode, &counts[batch.first], batch.indexType,
+										  &offsets[batch.first], batch.count, &baseVertices[batch.first]);
+		}
+	}
+	glBindVertexArray(0);
+}
+
+void DrawList::drawInstanced(GLsizei instanceCount) const
+{
+	GLuint bound = 0;
+	for (size_t i = 0; i < records.size(); ++i) {
+		const DrawRecord &record = records[i];
+		if (record.vertexArrayID != bound) {
+			glBindVertexArray(record.vertexArrayID);
+			bound = record.vertexArrayID;
+		}
+		glDrawElementsInstancedBaseVertex(record.mode, record.count, record.indexType,
+										  BUFFER_OFFSET(record.indexOffset), instanceCount, record.baseVertex);
+	}
+	glBindVertexArray(0);
+}
+
+void DrawList::clear()
+{
+	records.clear();
+	batches.clear();
+	counts.clear();
+	offsets.clear();
+	baseVertices.clear();
+}
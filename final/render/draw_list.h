@@ -0,0 +1,55 @@
+#ifndef _DRAW_LIST_H_
+#define _DRAW_LIST_H_
+
+#include <glad/gl.h>
+
+#include <vector>
+
+// One indexed draw, resolved from the asset when the model is bound. The VAO
+// carries the element array buffer; indexOffset is in bytes into it.
+struct DrawRecord {
+	GLuint vertexArrayID;
+	GLenum mode;
+	GLsizei count;
+	GLenum indexType;
+	GLintptr indexOffset;
+	GLint baseVertex;
+	int skin;				// Skin the vertices are bound to, -1 for rigid geometry
+};
+
+// Flat array of draws compiled once per model, replayed every pass without
+// touching the asset or walking its nodes. compile() merges runs of consecutive
+// records that share VAO, mode and index type into batches that go out as one
+// glMultiDrawElementsBaseVertex each.
+struct DrawList {
+	std::vector<DrawRecord> records;
+
+	void add(const DrawRecord &record) { records.push_back(record); }
+
+	// Builds the batches; call after the last add()
+	void compile();
+
+	void draw() const;
+
+	// Every record instanced; core 3.3 has no multi-draw for instancing, so one call per record
+	void drawInstanced(GLsizei instanceCount) const;
+
+	int batchCount() const { return int(batches.size()); }
+
+	void clear();
+
+private:
+	struct Batch {
+		GLuint vertexArrayID;
+		GLenum mode;
+		GLenum indexType;
+		int first;			// Into counts, offsets and baseVertices
+		int count;
+	};
+	std::vector<Batch> batches;
+	std::vector<GLsizei> counts;
+	std::vector<const void *> offsets;
+	std::vector<GLint> baseVertices;
+};
+
+#endif
@@ -0,0 +1,35 @@
+#include "frustum.h"
+
+void Frustum::extract(const glm::mat4 &matrix)
+{
+	// glm is column-major, row i is (m[0][i], m[1][i], m[2][i], m[3][i])
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; ++i) {
+		rows[i] = glm::vec4(matrix[0][i], matrix[1][i], matrix[2][i], matrix[3][i]);
+	}
+
+	planes[0] = rows[3] + rows[0];	// Left
+	planes[1] = rows[3] - rows[0];	// Right
+	planes[2] = rows[3] + rows[1];	// Bottom
+	planes[3] = rows[3] - rows[1];	// Top
+	planes[4] = rows[3] + rows[2];	// Near
+	planes[5] = rows[3] - rows[2];	// Far
+
+	for (int i = 0; i < 6; ++i) {
+		planes[i] /= glm::length(glm::vec3(planes[i]));
+	}
+}
+
+bool Frustum::intersectsBox(const glm::vec3 &boxMin, const glm::vec3 &boxMax) const
+{
+	for (int i = 0; i < 6; ++i) {
+		// Corner furthest along the plane normal
+		glm::vec3 corner(planes[i].x >= 0.0f ? boxMax.x : boxMin.x,
+						 planes[i].y >= 0.0f ? boxMax.y : boxMin.y,
+						 planes[i].z >= 0.0f ? boxMax.z : boxMin.z);
+		if (glm::dot(glm::vec3(planes[i]), corner) + planes[i].w < 0.0f) {
+			return false;
+		}
+	}
+	return true;
+}
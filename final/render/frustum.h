@@ -0,0 +1,17 @@
+#ifndef _FRUSTUM_H_
+#define _FRUSTUM_H_
+
+#include <glm/glm.hpp>
+
+// Six clip planes pulled out of a view-projection (or light-space) matrix,
+// each as (normal, distance) with the normal pointing inside.
+struct Frustum {
+	glm::vec4 planes[6];
+
+	void extract(const glm::mat4 &matrix);
+
+	// Conservative: true unless the box is entirely behind one plane
+	bool intersectsBox(const glm::vec3 &boxMin, const glm::vec3 &boxMax) const;
+};
+
+#endif
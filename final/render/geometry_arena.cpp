@@ -0,0 +1,54 @@
+#include "geometry_arena.h"
+
+#include <iostream>
+
+void GeometryArena::initialize(GLsizeiptr vertexCapacity, GLsizeiptr indexCapacity)
+{
+	this->vertexCapacity = vertexCapacity;
+	this->indexCapacity = indexCapacity;
+	vertexUsed = 0;
+	indexUsed = 0;
+
+	// Filled through the copy target, binding the element array buffer here would touch the current VAO
+	glGenBuffers(1, &vertexBufferID);
+	glGenBuffers(1, &indexBufferID);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, vertexBufferID);
+	glBufferData(GL_COPY_WRITE_BUFFER, vertexCapacity, nullptr, GL_STATIC_DRAW);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, indexBufferID);
+	glBufferData(GL_COPY_WRITE_BUFFER, indexCapacity, nullptr, GL_STATIC_DRAW);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+GLintptr GeometryArena::addVertices(const void *data, GLsizeiptr size)
+{
+	return allocate(vertexBufferID, vertexCapacity, vertexUsed, data, size);
+}
+
+GLintptr GeometryArena::addIndices(const void *data, GLsizeiptr size)
+{
+	return allocate(indexBufferID, indexCapacity, indexUsed, data, size);
+}
+
+GLintptr GeometryArena::allocate(GLuint buffer, GLsizeiptr capacity, GLsizeiptr &used, const void *data, GLsizeiptr size)
+{
+	if (used + allocationSize(size) > capacity) {
+		std::cerr << "Geometry arena full: " << used << " of " << capacity << " bytes used, "
+				  << size << " more requested" << std::endl;
+		return -1;
+	}
+	GLintptr offset = used;
+	used += allocationSize(size);
+
+	glBindBuffer(GL_COPY_WRITE_BUFFER, buffer);
+	glBufferSubData(GL_COPY_WRITE_BUFFER, offset, size, data);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	return offset;
+}
+
+void GeometryArena::cleanup()
+{
+	glDeleteBuffers(1, &vertexBufferID);
+	glDeleteBuffers(1, &indexBufferID);
+	vertexBufferID = 0;
+	indexBufferID = 0;
+}
@@ -0,0 +1,36 @@
+#ifndef _GEOMETRY_ARENA_H_
+#define _GEOMETRY_ARENA_H_
+
+#include <glad/gl.h>
+
+// One vertex buffer and one index buffer shared by every mesh of a model (or a
+// scene), sub-allocated front to back. Data is added once and referenced by byte
+// offset from any number of VAOs, so draws share bindings and GPU memory grows
+// with unique data only. Both buffers are sized up front; an allocation that does
+// not fit fails instead of reallocating under existing VAOs.
+struct GeometryArena {
+	static const GLsizeiptr alignment = 16;
+
+	GLuint vertexBufferID;
+	GLuint indexBufferID;
+	GLsizeiptr vertexCapacity;
+	GLsizeiptr indexCapacity;
+	GLsizeiptr vertexUsed;
+	GLsizeiptr indexUsed;
+
+	void initialize(GLsizeiptr vertexCapacity, GLsizeiptr indexCapacity);
+
+	// Copies data into the arena and returns its byte offset, -1 when it is full
+	GLintptr addVertices(const void *data, GLsizeiptr size);
+	GLintptr addIndices(const void *data, GLsizeiptr size);
+
+	// Bytes an allocation of size takes, for sizing the arena
+	static GLsizeiptr allocationSize(GLsizeiptr size) { return (size + alignment - 1) / alignment * alignment; }
+
+	void cleanup();
+
+private:
+	static GLintptr allocate(GLuint buffer, GLsizeiptr capacity, GLsizeiptr &used, const void *data, GLsizeiptr size);
+};
+
+#endif
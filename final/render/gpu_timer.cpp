@@ -0,0 +1,47 @@
+#include "gpu_timer.h"
+
+void GpuTimer::initialize()
+{
+	glGenQueries(latency, queries);
+	for (int i = 0; i < latency; ++i) {
+		pending[i] = false;
+	}
+	current = 0;
+	reset();
+}
+
+void GpuTimer::begin()
+{
+	// Collect the result this slot produced `latency` frames ago
+	if (pending[current]) {
+		GLuint64 elapsed = 0;
+		glGetQueryObjectui64v(queries[current], GL_QUERY_RESULT, &elapsed);
+		totalMilliseconds += double(elapsed) * 1e-6;
+		samples++;
+		pending[current] = false;
+	}
+	glBeginQuery(GL_TIME_ELAPSED, queries[current]);
+}
+
+void GpuTimer::end()
+{
+	glEndQuery(GL_TIME_ELAPSED);
+	pending[current] = true;
+	current = (current + 1) % latency;
+}
+
+double GpuTimer::averageMilliseconds() const
+{
+	return samples > 0 ? totalMilliseconds / samples : 0.0;
+}
+
+void GpuTimer::reset()
+{
+	totalMilliseconds = 0.0;
+	samples = 0;
+}
+
+void GpuTimer::cleanup()
+{
+	glDeleteQueries(latency, queries);
+}
@@ -0,0 +1,26 @@
+#ifndef _GPU_TIMER_H_
+#define _GPU_TIMER_H_
+
+#include <glad/gl.h>
+
+// GL_TIME_ELAPSED query ring. Results are read a few frames late so the CPU
+// never waits on the GPU; averageMilliseconds() covers everything resolved
+// since the last reset().
+struct GpuTimer {
+	static const int latency = 4;
+
+	GLuint queries[latency];
+	bool pending[latency];
+	int current;
+	double totalMilliseconds;
+	int samples;
+
+	void initialize();
+	void begin();
+	void end();
+	double averageMilliseconds() const;
+	void reset();
+	void cleanup();
+};
+
+#endif
@@ -0,0 +1,81 @@
+#include "program.h"
+#include "shader.h"
+
+#include <iostream>
+#include <vector>
+
+bool ShaderProgram::load(const char *vertexPath, const char *fragmentPath,
+						 const char *const *feedbackVaryings, int feedbackVaryingCount)
+{
+	id = LoadShadersFromFile(vertexPath, fragmentPath, feedbackVaryings, feedbackVaryingCount);
+	uniforms.clear();
+	if (id == 0) {
+		std::cerr << "Failed to load program " << vertexPath << " / " << fragmentPath << std::endl;
+		return false;
+	}
+
+	// Reflect every active default-block uniform
+	GLint count = 0, maxLength = 0;
+	glGetProgramiv(id, GL_ACTIVE_UNIFORMS, &count);
+	glGetProgramiv(id, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+	std::vector<char> name(maxLength + 1);
+	for (GLint i = 0; i < count; ++i) {
+		GLsizei length = 0;
+		GLint size = 0;
+		GLenum type = 0;
+		glGetActiveUniform(id, GLuint(i), GLsizei(name.size()), &length, &size, &type, name.data());
+
+		GLint location = glGetUniformLocation(id, name.data());
+		if (location < 0) {
+			continue;	// Member of a uniform block
+		}
+
+		// Arrays are reported as "name[0]"; register the bare name too
+		std::string uniformName(name.data(), length);
+		uniforms[uniformName] = location;
+		size_t bracket = uniformName.find('[');
+		if (bracket != std::string::npos) {
+			uniforms[uniformName.substr(0, bracket)] = location;
+		}
+	}
+
+	// Every program that declares the shared block reads it from the same binding
+	GLuint blockIndex = glGetUniformBlockIndex(id, "FrameUniforms");
+	if (blockIndex != GL_INVALID_INDEX) {
+		glUniformBlockBinding(id, blockIndex, frameUniformsBinding);
+	}
+	return true;
+}
+
+GLint ShaderProgram::location(const char *name) const
+{
+	std::map<std::string, GLint>::const_iterator it = uniforms.find(name);
+	return it != uniforms.end() ? it->second : -1;
+}
+
+void ShaderProgram::cleanup()
+{
+	glDeleteProgram(id);
+	id = 0;
+}
+
+void FrameUniformBuffer::initialize()
+{
+	glGenBuffers(1, &bufferID);
+	glBindBuffer(GL_UNIFORM_BUFFER, bufferID);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniformData), nullptr, GL_DYNAMIC_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, frameUniformsBinding, bufferID);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void FrameUniformBuffer::update(const FrameUniformData &data)
+{
+	glBindBuffer(GL_UNIFORM_BUFFER, bufferID);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameUniformData), &data);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void FrameUniformBuffer::cleanup()
+{
+	glDeleteBuffers(1, &bufferID);
+}
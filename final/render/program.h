@@ -0,0 +1,52 @@
+#ifndef _PROGRAM_H_
+#define _PROGRAM_H_
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+
+#include <map>
+#include <string>
+
+// Binding point of the FrameUniforms block declared in frame_uniforms.glsl
+static const GLuint frameUniformsBinding = 0;
+
+// Upper bound on shadow cascades, sizes the light-space matrix array in frame_uniforms.glsl
+static const int maxShadowCascades = 4;
+
+// Linked program with its active uniforms reflected once at load time.
+// Look locations up during initialisation and keep them; location() never
+// calls into the driver.
+struct ShaderProgram {
+	GLuint id;
+	std::map<std::string, GLint> uniforms;
+
+	ShaderProgram() : id(0) {}
+
+	bool load(const char *vertexPath, const char *fragmentPath,
+			  const char *const *feedbackVaryings = nullptr, int feedbackVaryingCount = 0);
+	GLint location(const char *name) const;
+	void cleanup();
+};
+
+// std140 mirror of the FrameUniforms block, written once per frame
+struct FrameUniformData {
+	glm::mat4 viewProjection;
+	glm::mat4 lightSpaceMatrices[2 * maxShadowCascades];
+	glm::vec4 cameraPosition;
+	glm::vec4 cameraDirection;
+	glm::vec4 cascadeSplits;
+	glm::vec4 shadowParameters;
+	glm::vec4 lightDirection;
+	glm::vec4 lightPosition;
+	glm::vec4 lightIntensity;
+};
+
+struct FrameUniformBuffer {
+	GLuint bufferID;
+
+	void initialize();
+	void update(const FrameUniformData &data);
+	void cleanup();
+};
+
+#endif
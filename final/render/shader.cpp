@@ -6,7 +6,57 @@
 #include <sstream> 
 #include <vector>
 
-GLuint LoadShadersFromFile(const char *vertex_file_path, const char *fragment_file_path)
+// Splices `#include "file"` lines with the named file, resolved next to the including shader
+static bool ExpandShaderIncludes(std::string &code, const std::string &path, int depth = 0)
+{
+	if (depth > 8) {
+		printf("Shader includes nested too deeply in %s.\n", path.c_str());
+		return false;
+	}
+
+	std::string directory;
+	size_t slash = path.find_last_of("/\\");
+	if (slash != std::string::npos) {
+		directory = path.substr(0, slash + 1);
+	}
+
+	std::istringstream input(code);
+	std::stringstream output;
+	std::string line;
+	while (std::getline(input, line)) {
+		size_t start = line.find_first_not_of(" \t");
+		if (start == std::string::npos || line.compare(start, 8, "#include") != 0) {
+			output << line << "\n";
+			continue;
+		}
+
+		size_t open = line.find('"', start);
+		size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+		if (close == std::string::npos) {
+			printf("Malformed include in %s: %s\n", path.c_str(), line.c_str());
+			return false;
+		}
+
+		std::string includePath = directory + line.substr(open + 1, close - open - 1);
+		std::ifstream includeStream(includePath.c_str(), std::ios::in);
+		if (!includeStream.is_open()) {
+			printf("Shader include not found %s.\n", includePath.c_str());
+			return false;
+		}
+		std::stringstream sstr;
+		sstr << includeStream.rdbuf();
+		std::string included = sstr.str();
+		if (!ExpandShaderIncludes(included, includePath, depth + 1)) {
+			return false;
+		}
+		output << included << "\n";
+	}
+	code = output.str();
+	return true;
+}
+
+GLuint LoadShadersFromFile(const char *vertex_file_path, const char *fragment_file_path,
+						   const char *const *feedbackVaryings, int feedbackVaryingCount)
 {
 	// Create the shaders
 	GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
@@ -21,6 +71,9 @@ GLuint LoadShadersFromFile(const char *vertex_file_path, const char *fragment_fi
 		sstr << VertexShaderStream.rdbuf();
 		VertexShaderCode = sstr.str();
 		VertexShaderStream.close();
+		if (!ExpandShaderIncludes(VertexShaderCode, vertex_file_path)) {
+			return 0;
+		}
 	}
 	else
 	{
@@ -37,6 +90,9 @@ GLuint LoadShadersFromFile(const char *vertex_file_path, const char *fragment_fi
 		sstr << FragmentShaderStream.rdbuf();
 		FragmentShaderCode = sstr.str();
 		FragmentShaderStream.close();
+		if (!ExpandShaderIncludes(FragmentShaderCode, fragment_file_path)) {
+			return 0;
+		}
 	}
 	else
 	{
@@ -91,6 +147,9 @@ GLuint LoadShadersFromFile(const char *vertex_file_path, const char *fragment_fi
 	GLuint ProgramID = glCreateProgram();
 	glAttachShader(ProgramID, VertexShaderID);
 	glAttachShader(ProgramID, FragmentShaderID);
+	if (feedbackVaryingCount > 0) {
+		glTransformFeedbackVaryings(ProgramID, feedbackVaryingCount, feedbackVaryings, GL_INTERLEAVED_ATTRIBS);
+	}
 	glLinkProgram(ProgramID);
 
 	// Check the program
@@ -4,7 +4,9 @@
 #include <glad/gl.h>
 #include <string>
 
-GLuint LoadShadersFromFile(const char *vertex_file_path, const char *fragment_file_path);
+// Varyings named in feedbackVaryings are captured, interleaved in that order, by transform feedback
+GLuint LoadShadersFromFile(const char *vertex_file_path, const char *fragment_file_path,
+						   const char *const *feedbackVaryings = nullptr, int feedbackVaryingCount = 0);
 
 GLuint LoadShadersFromString(std::string VertexShaderCode, std::string FragmentShaderCode);
 
@@ -0,0 +1,314 @@
+#include "shadow.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+void CascadedShadowMap::initialize(int cascadeCount, int resolution)
+{
+	this->cascadeCount = std::max(1, std::min(cascadeCount, maxShadowCascades));
+	this->resolution = resolution;
+	splitLambda = 0.75f;
+	casterDistance = 100.0f;
+	filterMode = SHADOW_FILTER_COMPARE;
+
+	// Two views of the same depth: raw values for manual tests and gathers, and hardware comparison
+	glGenSamplers(1, &depthSamplerID);
+	glSamplerParameteri(depthSamplerID, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glSamplerParameteri(depthSamplerID, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glSamplerParameteri(depthSamplerID, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glSamplerParameteri(depthSamplerID, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	glGenSamplers(1, &compareSamplerID);
+	glSamplerParameteri(compareSamplerID, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glSamplerParameteri(compareSamplerID, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glSamplerParameteri(compareSamplerID, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glSamplerParameteri(compareSamplerID, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glSamplerParameteri(compareSamplerID, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+	glSamplerParameteri(compareSamplerID, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+
+	// Moment blur, a fullscreen triangle from gl_VertexID still needs a bound VAO
+	blurProgram.load("../final/shadow_blur.vert", "../final/shadow_blur.frag");
+	blurLayerID = blurProgram.location("layer");
+	blurDirectionID = blurProgram.location("direction");
+	blurToMomentsID = blurProgram.location("toMoments");
+	glUseProgram(blurProgram.id);
+	glUniform1i(blurProgram.location("source"), 0);
+	glUseProgram(0);
+	glGenVertexArrays(1, &blurVertexArrayID);
+
+	createTargets();
+
+	for (int i = 0; i < maxShadowCascades; ++i) {
+		matrices[i] = glm::mat4(1.0f);
+		staticLayerMatrices[i] = glm::mat4(1.0f);
+		staticOffsets[i][0] = staticOffsets[i][1] = 0;
+		splits[i] = 0.0f;
+	}
+	staticRevision = 0;
+	staticRebuilds = 0;
+}
+
+void CascadedShadowMap::resize(int resolution)
+{
+	if (resolution == this->resolution) {
+		return;
+	}
+	deleteTargets();
+	this->resolution = resolution;
+	createTargets();
+}
+
+void CascadedShadowMap::createTargets()
+{
+	// A quarter of a cascade each way before the cached static casters are redrawn
+	staticGuard = resolution / 4;
+	staticResolution = resolution + staticGuard;
+	createDepthArray(textureID, framebufferID, resolution, "Shadow cascade");
+	createDepthArray(staticTextureID, staticFramebufferID, staticResolution, "Static shadow cascade");
+	createColourArray(momentsTextureID, momentsFramebufferID, cascadeCount, "Shadow moments");
+	createColourArray(blurTextureID, blurFramebufferID, 1, "Shadow moment blur");
+
+	// Nothing is cached in the new layers yet
+	for (int i = 0; i < maxShadowCascades; ++i) {
+		cachedRevision[i] = -1;
+	}
+}
+
+void CascadedShadowMap::deleteTargets()
+{
+	glDeleteFramebuffers(1, &framebufferID);
+	glDeleteTextures(1, &textureID);
+	glDeleteFramebuffers(1, &staticFramebufferID);
+	glDeleteTextures(1, &staticTextureID);
+	glDeleteFramebuffers(1, &momentsFramebufferID);
+	glDeleteTextures(1, &momentsTextureID);
+	glDeleteFramebuffers(1, &blurFramebufferID);
+	glDeleteTextures(1, &blurTextureID);
+}
+
+void CascadedShadowMap::createDepthArray(GLuint &texture, GLuint &framebuffer, int size, const char *name)
+{
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, size, size, cascadeCount,
+				 0, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		std::cerr << name << " FBO not complete!" << std::endl;
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+// Depth and its square, linearly filtered so VSM lookups get hardware bilinear on top of the blur
+void CascadedShadowMap::createColourArray(GLuint &texture, GLuint &framebuffer, int layers, const char *name)
+{
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RG32F, resolution, resolution, layers, 0, GL_RG, GL_FLOAT, nullptr);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	glGenFramebuffers(1, &framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+	glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, texture, 0, 0);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		std::cerr << name << " FBO not complete!" << std::endl;
+	}
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void CascadedShadowMap::update(const glm::mat4 &view, float fovY, float aspect, float zNear, float shadowDistance,
+							   const glm::vec3 &lightDirection, const glm::vec3 &lightUp)
+{
+	glm::mat4 inverseView = glm::inverse(view);
+	glm::vec3 direction = glm::normalize(lightDirection);
+	glm::vec3 up = std::fabs(glm::dot(direction, glm::normalize(lightUp))) > 0.99f ? glm::vec3(1, 0, 0) : lightUp;
+
+	// Light-space basis, the same one glm::lookAt builds
+	glm::vec3 lightRight = glm::normalize(glm::cross(direction, up));
+	glm::vec3 lightUpAxis = glm::cross(lightRight, direction);
+
+	float tanHalfY = std::tan(0.5f * fovY);
+	float tanHalfX = tanHalfY * aspect;
+
+	float sliceNear = zNear;
+	for (int c = 0; c < cascadeCount; ++c) {
+		// Blend of logarithmic and uniform splits
+		float t = float(c + 1) / float(cascadeCount);
+		float logSplit = zNear * std::pow(shadowDistance / zNear, t);
+		float uniformSplit = zNear + (shadowDistance - zNear) * t;
+		float sliceFar = splitLambda * logSplit + (1.0f - splitLambda) * uniformSplit;
+		splits[c] = sliceFar;
+
+		// Bounding sphere of the slice's corners. Only depends on the slice, so it is stable under rotation.
+		glm::vec3 corners[8];
+		glm::vec3 centre(0.0f);
+		for (int i = 0; i < 8; ++i) {
+			float depth = (i & 4) ? sliceFar : sliceNear;
+			glm::vec4 corner(((i & 1) ? 1.0f : -1.0f) * tanHalfX * depth,
+							 ((i & 2) ? 1.0f : -1.0f) * tanHalfY * depth, -depth, 1.0f);
+			corners[i] = glm::vec3(inverseView * corner);
+			centre += corners[i] / 8.0f;
+		}
+		float radius = 0.0f;
+		for (int i = 0; i < 8; ++i) {
+			radius = std::max(radius, glm::length(corners[i] - centre));
+		}
+		radius = std::ceil(radius * 16.0f) / 16.0f;
+
+		// Snap the centre to whole texels across the light and to coarse steps along it, so the
+		// map moves in texel steps and does not swim
+		float texel = 2.0f * radius / resolution;
+		float depthStep = 0.25f * radius;
+		float texelX = std::floor(glm::dot(centre, lightRight) / texel);
+		float texelY = std::floor(glm::dot(centre, lightUpAxis) / texel);
+		float depth = std::floor(glm::dot(centre, direction) / depthStep) * depthStep;
+		float depthRange = 2.0f * radius + casterDistance + depthStep;
+		centre = lightRight * (texelX * texel) + lightUpAxis * (texelY * texel) + direction * depth;
+
+		// Fixed up vector, the eye backs off far enough to catch casters between the light and the slice
+		glm::vec3 eye = centre - direction * (radius + casterDistance);
+		glm::mat4 lightView = glm::lookAt(eye, centre, up);
+		glm::mat4 lightProjection = glm::ortho(-radius, radius, -radius, radius, 0.0f, depthRange);
+
+		matrices[c] = lightProjection * lightView;
+		frustums[c].extract(matrices[c]);
+
+		// The cached static layer: same texels and depth mapping, its corner on a grid of staticGuard
+		// texels so the cascade lies inside it. Its matrix only changes when the camera crosses a grid
+		// step, which is what keeps the cached layer valid.
+		float anchorX = std::floor(texelX / staticGuard) * staticGuard;
+		float anchorY = std::floor(texelY / staticGuard) * staticGuard;
+		staticOffsets[c][0] = int(texelX - anchorX);
+		staticOffsets[c][1] = int(texelY - anchorY);
+		float staticRadius = radius + 0.5f * staticGuard * texel;
+		glm::vec3 staticCentre = lightRight * ((anchorX + 0.5f * staticGuard) * texel)
+							   + lightUpAxis * ((anchorY + 0.5f * staticGuard) * texel) + direction * depth;
+		glm::vec3 staticEye = staticCentre - direction * (radius + casterDistance);
+		staticLayerMatrices[c] = glm::ortho(-staticRadius, staticRadius, -staticRadius, staticRadius, 0.0f, depthRange)
+							   * glm::lookAt(staticEye, staticCentre, up);
+		staticFrustums[c].extract(staticLayerMatrices[c]);
+		sliceNear = sliceFar;
+	}
+}
+
+void CascadedShadowMap::begin()
+{
+	glGetIntegerv(GL_VIEWPORT, savedViewport);
+	glViewport(0, 0, resolution, resolution);
+}
+
+void CascadedShadowMap::markStaticCastersChanged()
+{
+	staticRevision++;
+}
+
+bool CascadedShadowMap::beginStaticCascade(int cascade)
+{
+	if (cachedRevision[cascade] == staticRevision && staticMatrices[cascade] == staticLayerMatrices[cascade]) {
+		return false;
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, staticFramebufferID);
+	glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, staticTextureID, 0, cascade);
+	glViewport(0, 0, staticResolution, staticResolution);
+	glClear(GL_DEPTH_BUFFER_BIT);
+
+	staticMatrices[cascade] = staticLayerMatrices[cascade];
+	cachedRevision[cascade] = staticRevision;
+	staticRebuilds++;
+	return true;
+}
+
+void CascadedShadowMap::beginCascade(int cascade)
+{
+	// Start from the cascade's window of the static casters, the dynamic ones are drawn on top
+	int x = staticOffsets[cascade][0], y = staticOffsets[cascade][1];
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, staticFramebufferID);
+	glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, staticTextureID, 0, cascade);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, framebufferID);
+	glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, textureID, 0, cascade);
+	glBlitFramebuffer(x, y, x + resolution, y + resolution, 0, 0, resolution, resolution, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, framebufferID);
+	glViewport(0, 0, resolution, resolution);
+}
+
+void CascadedShadowMap::end()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(savedViewport[0], savedViewport[1], savedViewport[2], savedViewport[3]);
+}
+
+void CascadedShadowMap::prefilter()
+{
+	if (filterMode != SHADOW_FILTER_VSM) {
+		return;
+	}
+
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	glViewport(0, 0, resolution, resolution);
+	glUseProgram(blurProgram.id);
+	glBindVertexArray(blurVertexArrayID);
+	glActiveTexture(GL_TEXTURE0);
+
+	for (int c = 0; c < cascadeCount; ++c) {
+		// Across: depth to moments, into the scratch layer
+		glBindFramebuffer(GL_FRAMEBUFFER, blurFramebufferID);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, textureID);
+		glUniform1i(blurLayerID, c);
+		glUniform2i(blurDirectionID, 1, 0);
+		glUniform1i(blurToMomentsID, 1);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+
+		// Down: scratch layer into the cascade's moments
+		glBindFramebuffer(GL_FRAMEBUFFER, momentsFramebufferID);
+		glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, momentsTextureID, 0, c);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, blurTextureID);
+		glUniform1i(blurLayerID, 0);
+		glUniform2i(blurDirectionID, 0, 1);
+		glUniform1i(blurToMomentsID, 0);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+	}
+
+	glBindVertexArray(0);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
+
+void CascadedShadowMap::bind() const
+{
+	glActiveTexture(GL_TEXTURE0 + shadowTextureUnit);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, textureID);
+	glBindSampler(shadowTextureUnit, depthSamplerID);
+	glActiveTexture(GL_TEXTURE0 + shadowTextureUnit + 1);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, textureID);
+	glBindSampler(shadowTextureUnit + 1, compareSamplerID);
+	glActiveTexture(GL_TEXTURE0 + shadowTextureUnit + 2);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, momentsTextureID);
+	glActiveTexture(GL_TEXTURE0);
+}
+
+void CascadedShadowMap::cleanup()
+{
+	deleteTargets();
+	glDeleteSamplers(1, &depthSamplerID);
+	glDeleteSamplers(1, &compareSamplerID);
+	glDeleteVertexArrays(1, &blurVertexArrayID);
+	blurProgram.cleanup();
+}
@@ -0,0 +1,119 @@
+#ifndef _SHADOW_H_
+#define _SHADOW_H_
+
+#include <glad/gl.h>
+#include <glm/glm.hpp>
+
+#include "frustum.h"
+#include "program.h"
+
+// How receivers filter the cascades, mirrored by the SHADOW_FILTER_* defines in shadow.glsl
+enum ShadowFilterMode {
+	SHADOW_FILTER_HARD,			// One manual depth comparison per fragment
+	SHADOW_FILTER_COMPARE,		// Hardware comparison sampler, bilinear 2x2 PCF
+	SHADOW_FILTER_GATHER,		// 4x4 texel PCF from four textureGather fetches
+	SHADOW_FILTER_VSM,			// Blurred depth moments and Chebyshev's bound
+	SHADOW_FILTER_MODE_COUNT
+};
+static const char *const shadowFilterModeNames[] = { "hard", "hardware compare", "gather PCF", "VSM" };
+
+// Receivers sample the cascades from fixed units: raw depth here, the comparison
+// sampler on the next unit and the blurred moments on the one after
+static const GLuint shadowTextureUnit = 8;
+
+// Cascaded shadow maps for a directional light, one depth layer per slice of the
+// camera frustum. Each cascade is an ortho box around its slice's bounding sphere,
+// so its size does not change as the camera turns, and is snapped to whole
+// texels so the map does not swim as the camera moves.
+//
+// Static casters go into a cached layer per cascade that is a guard band wider than
+// the cascade, anchored on a grid of staticGuard texels. The cascade still moves in
+// single texels inside it, so the layer is only redrawn when the camera crosses a
+// grid step, the light or the cascade size changes, or markStaticCastersChanged()
+// is called; otherwise a frame costs one depth blit plus the dynamic casters.
+//
+// The same depth array is bound through two sampler objects, one plain and one
+// with GL_COMPARE_REF_TO_TEXTURE, so every filter mode reads the one map. VSM
+// additionally needs prefilter() to blur depth moments into their own array.
+struct CascadedShadowMap {
+	int cascadeCount;
+	int resolution;
+	float splitLambda;          // 0 splits uniformly, 1 logarithmically
+	float casterDistance;       // Casters this far towards the light still land in a cascade
+	ShadowFilterMode filterMode;
+
+	GLuint textureID;
+	GLuint framebufferID;
+	GLint savedViewport[4];
+
+	GLuint staticTextureID;
+	GLuint staticFramebufferID;
+	int staticGuard;                               // Extra texels per side, also the anchor grid step
+	int staticResolution;                          // resolution + staticGuard
+	glm::mat4 staticLayerMatrices[maxShadowCascades];   // Where each cached layer belongs this frame
+	Frustum staticFrustums[maxShadowCascades];
+	int staticOffsets[maxShadowCascades][2];       // Texels from a cached layer's corner to its cascade's
+	glm::mat4 staticMatrices[maxShadowCascades];   // Matrix each cached layer was drawn with
+	int staticRevision;
+	int cachedRevision[maxShadowCascades];
+	int staticRebuilds;                            // Cached layers redrawn, for the timing report
+
+	GLuint depthSamplerID;
+	GLuint compareSamplerID;
+
+	// VSM: moments are blurred across into blurTextureID, then down into one layer of momentsTextureID
+	GLuint momentsTextureID;
+	GLuint momentsFramebufferID;
+	GLuint blurTextureID;
+	GLuint blurFramebufferID;
+	GLuint blurVertexArrayID;
+	ShaderProgram blurProgram;
+	GLint blurLayerID;
+	GLint blurDirectionID;
+	GLint blurToMomentsID;
+
+	glm::mat4 matrices[maxShadowCascades];
+	Frustum frustums[maxShadowCascades];   // For culling casters per cascade
+	float splits[maxShadowCascades];       // View depth where each cascade ends
+
+	void initialize(int cascadeCount, int resolution);
+
+	// Recreates the maps at a new size; every cached static layer is redrawn
+	void resize(int resolution);
+
+	// Refits every cascade to the camera; shadowDistance is where the last one ends
+	void update(const glm::mat4 &view, float fovY, float aspect, float zNear, float shadowDistance,
+				const glm::vec3 &lightDirection, const glm::vec3 &lightUp);
+
+	// A static caster moved, appeared or disappeared
+	void markStaticCastersChanged();
+
+	// Casters draw with lightSpaceMatrices[index] from the frame uniforms: the cascades,
+	// then the cached static layers
+	static int staticLayerIndex(int cascade) { return maxShadowCascades + cascade; }
+
+	// begin() binds the map and end() restores the viewport. Per cascade, beginStaticCascade()
+	// returns true with the cached layer bound and cleared when the static casters must be
+	// redrawn, culled by staticFrustums and drawn at staticLayerIndex(); beginCascade() then
+	// copies the cascade's part of the cached layer in for the dynamic casters.
+	void begin();
+	bool beginStaticCascade(int cascade);
+	void beginCascade(int cascade);
+	void end();
+
+	// After the casters are drawn: builds the blurred moments when filtering with VSM
+	void prefilter();
+
+	// Binds the depth array, its samplers and the moments from shadowTextureUnit up
+	void bind() const;
+
+	void cleanup();
+
+private:
+	void createTargets();
+	void deleteTargets();
+	void createDepthArray(GLuint &texture, GLuint &framebuffer, int size, const char *name);
+	void createColourArray(GLuint &texture, GLuint &framebuffer, int layers, const char *name);
+};
+
+#endif
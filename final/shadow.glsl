@@ -0,0 +1,105 @@
+// Cascaded shadow lookup; matrices and splits come from the frame uniform block.
+// Including shaders enable GL_ARB_texture_gather when the driver has it.
+uniform sampler2DArray shadowMap;                // Raw depth
+uniform sampler2DArrayShadow shadowMapCompare;   // The same depth through a comparison sampler
+uniform sampler2DArray shadowMoments;            // Blurred depth moments, VSM only
+
+// Mirrors ShadowFilterMode in render/shadow.h, selected by shadowParameters.y
+#define SHADOW_FILTER_HARD 0
+#define SHADOW_FILTER_COMPARE 1
+#define SHADOW_FILTER_GATHER 2
+#define SHADOW_FILTER_VSM 3
+
+// Depth of the 2x2 texels a bilinear lookup at uv would use, in textureGather order
+vec4 gatherShadowDepth(vec3 uv)
+{
+#ifdef GL_ARB_texture_gather
+    return textureGather(shadowMap, uv);
+#else
+    ivec2 size = textureSize(shadowMap, 0).xy;
+    ivec2 texel = ivec2(floor(uv.xy * vec2(size) - 0.5));
+    int layer = int(uv.z);
+    return vec4(texelFetch(shadowMap, ivec3(clamp(texel + ivec2(0, 1), ivec2(0), size - 1), layer), 0).r,
+                texelFetch(shadowMap, ivec3(clamp(texel + ivec2(1, 1), ivec2(0), size - 1), layer), 0).r,
+                texelFetch(shadowMap, ivec3(clamp(texel + ivec2(1, 0), ivec2(0), size - 1), layer), 0).r,
+                texelFetch(shadowMap, ivec3(clamp(texel, ivec2(0), size - 1), layer), 0).r);
+#endif
+}
+
+// Tent-filtered PCF over the 4x4 texels around uv, from four gathers
+float gatherShadow(vec3 uv, float layer, float reference)
+{
+    vec2 size = vec2(textureSize(shadowMap, 0).xy);
+    vec2 texel = uv.xy * size - 0.5;
+    vec2 base = floor(texel);
+    vec2 f = texel - base;
+
+    // Per-axis weights of a 3x3 bilinear PCF kernel spread over 4 texels
+    vec4 weightX = vec4(1.0 - f.x, 1.0, 1.0, f.x);
+    vec4 weightY = vec4(1.0 - f.y, 1.0, 1.0, f.y);
+
+    float lit = 0.0;
+    for (int y = 0; y < 2; ++y) {
+        for (int x = 0; x < 2; ++x) {
+            // Centre of the 2x2 block starting at texel base - 1 + 2 * (x, y)
+            vec2 centre = (base + vec2(2 * x, 2 * y)) / size;
+            vec4 lit4 = step(vec4(reference), gatherShadowDepth(vec3(centre, layer)));
+            float x0 = weightX[2 * x], x1 = weightX[2 * x + 1];
+            float y0 = weightY[2 * y], y1 = weightY[2 * y + 1];
+            lit += dot(lit4, vec4(x0 * y1, x1 * y1, x1 * y0, x0 * y0));
+        }
+    }
+    return lit / 9.0;
+}
+
+// Chebyshev's upper bound on the lit fraction, with the low end cut off to reduce light bleeding
+float varianceShadow(vec3 uv, float layer)
+{
+    vec2 moments = texture(shadowMoments, vec3(uv.xy, layer)).xy;
+    if (uv.z <= moments.x) {
+        return 1.0;
+    }
+    float variance = max(moments.y - moments.x * moments.x, 0.00002);
+    float d = uv.z - moments.x;
+    float pMax = variance / (variance + d * d);
+    return clamp((pMax - 0.3) / 0.7, 0.0, 1.0);
+}
+
+// 1 when lit, 0 when shadowed. Beyond the last cascade everything is lit.
+float shadowVisibility(vec3 worldPosition, vec3 normal)
+{
+    // Pick the cascade by view depth
+    float viewDepth = dot(worldPosition - cameraPosition.xyz, cameraDirection.xyz);
+    int cascadeCount = int(shadowParameters.x);
+    int cascade = 0;
+    while (cascade < cascadeCount && viewDepth > cascadeSplits[cascade]) {
+        cascade++;
+    }
+    if (cascade == cascadeCount) {
+        return 1.0;
+    }
+
+    vec4 lightSpace = lightSpaceMatrices[cascade] * vec4(worldPosition, 1.0);
+    vec3 uv = lightSpace.xyz / lightSpace.w * 0.5 + 0.5;
+    if (uv.x < 0.0 || uv.x > 1.0 || uv.y < 0.0 || uv.y > 1.0 || uv.z > 1.0) {
+        return 1.0;
+    }
+
+    int filterMode = int(shadowParameters.y);
+    float layer = float(cascade);
+    if (filterMode == SHADOW_FILTER_VSM) {
+        return varianceShadow(uv, layer);
+    }
+
+    float bias = max(0.005 * (1.0 - dot(normal, -lightDirection.xyz)), 0.0005);
+    float reference = uv.z - bias;
+    if (filterMode == SHADOW_FILTER_COMPARE) {
+        return texture(shadowMapCompare, vec4(uv.xy, layer, reference));
+    }
+    if (filterMode == SHADOW_FILTER_GATHER) {
+        return gatherShadow(uv, layer, reference);
+    }
+
+    float existingDepth = texture(shadowMap, vec3(uv.xy, layer)).r;
+    return reference > existingDepth ? 0.0 : 1.0;
+}
@@ -0,0 +1,29 @@
+#version 330 core
+
+// One direction of the separable VSM blur. The first pass reads shadow depth and
+// turns each tap into moments (depth, depth squared), the second blurs those.
+uniform sampler2DArray source;
+uniform int layer;
+uniform ivec2 direction;
+uniform int toMoments;
+
+out vec2 moments;
+
+const int radius = 2;
+const float weights[5] = float[](0.0625, 0.25, 0.375, 0.25, 0.0625);
+
+void main()
+{
+    ivec2 size = textureSize(source, 0).xy;
+    ivec2 texel = ivec2(gl_FragCoord.xy);
+
+    moments = vec2(0.0);
+    for (int i = -radius; i <= radius; ++i) {
+        ivec2 tap = clamp(texel + direction * i, ivec2(0), size - 1);
+        vec2 value = texelFetch(source, ivec3(tap, layer), 0).rg;
+        if (toMoments != 0) {
+            value = vec2(value.r, value.r * value.r);
+        }
+        moments += weights[i + radius] * value;
+    }
+}
@@ -0,0 +1,24 @@
+// Linear blend skinning with up to four joints per vertex
+#include "joint_palette.glsl"
+#include "baked_animation.glsl"
+
+layout(location = 3) in uvec4 a_joint;     // Integer attribute, set with glVertexAttribIPointer
+layout(location = 4) in vec4 a_weight;
+
+uniform samplerBuffer jointPalette;         // The current pose, sized from the skin at load time
+uniform int bakedSkinning;      // Read the joints from the baked clip at animationTime instead
+uniform float animationTime;
+
+mat4 jointMatrix(uint joint) {
+    if (bakedSkinning != 0) {
+        return bakedJointMatrix(animationTime, int(joint));
+    }
+    return paletteJointMatrix(jointPalette, 3 * int(joint));
+}
+
+mat4 skinMatrix() {
+    return a_weight.x * jointMatrix(a_joint.x)
+        + a_weight.y * jointMatrix(a_joint.y)
+        + a_weight.z * jointMatrix(a_joint.z)
+        + a_weight.w * jointMatrix(a_joint.w);
+}
@@ -1,5 +1,7 @@
 #version 330 core
 
+#include "frame_uniforms.glsl"
+
 layout(location = 0) in vec3 vertexPosition;
 layout(location = 1) in vec3 vertexColor;
 layout(location = 2) in vec2 vertexUV;
@@ -7,10 +9,10 @@ layout(location = 2) in vec2 vertexUV;
 out vec3 color;
 out vec2 uv;
 
-uniform mat4 MVP;
+uniform mat4 modelMatrix;
 
 void main() {
-    gl_Position =  MVP * vec4(vertexPosition, 1);
+    gl_Position =  viewProjection * modelMatrix * vec4(vertexPosition, 1);
     color = vertexColor;
     uv = vertexUV;    
 }
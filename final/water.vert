@@ -1,27 +1,46 @@
 #version 330 core
-layout(location = 0) in vec3 vertexPosition;
-layout(location = 1) in vec2 vertexUV;
+
+#include "frame_uniforms.glsl"
+
+#define MAX_CLIPMAP_LEVELS 8
+
+layout(location = 0) in vec4 blockInstance;     // World xz of the block's first vertex, level
 
 out vec2 fragUV;
 out vec3 worldPosition;
-out vec4 fragPosLightSpace;
 
-uniform mat4 MVP;
-uniform sampler2D heightMap;
-uniform mat4 lightSpaceMatrix;
-uniform sampler2D shadowMap;
+uniform sampler2DArray oceanMap;   // Layer 0: choppy x, height, choppy z
+uniform int blockSize;          // Cells along a clipmap block edge
+uniform float patchLength;      // World extent of one period of the ocean map
+uniform vec4 levelData[MAX_CLIPMAP_LEVELS];    // Spacing, camera distance where odd vertices start/finish collapsing, height mip
+uniform int shadowPass;         // Project with the light instead of the camera
+uniform int cascadeIndex;       // Shadow cascade drawn by the shadow pass
 
 void main() {
-    fragUV = vertexUV;
-    worldPosition = vertexPosition;
+    // No vertex attributes, the strip indices are vertex ids within the block
+    vec2 gridPosition = vec2(gl_VertexID % (blockSize + 1), gl_VertexID / (blockSize + 1));
+    vec4 level = levelData[int(blockInstance.z)];
+    float gridSpacing = level.x;
+    vec2 morphRange = level.yz;
+    float heightLod = level.w;
+    vec2 world = blockInstance.xy + gridPosition * gridSpacing;
 
-    // Displace based on height map
-    float height = texture(heightMap, fragUV).r;
-    height = sign(height) * (1.0 - exp(-abs(height)));
-    vec3 displacedPosition = vertexPosition;
-    displacedPosition.y += height * 0.4;  
+    // Collapse odd vertices onto the next coarser level towards the outer edge of the ring
+    vec2 fromCamera = abs(world - cameraPosition.xz);
+    float morph = clamp((max(fromCamera.x, fromCamera.y) - morphRange.x) / (morphRange.y - morphRange.x), 0.0, 1.0);
+    world -= fract(gridPosition * 0.5) * 2.0 * gridSpacing * morph;
+
+    // World-anchored lookup, the ocean map tiles with GL_REPEAT
+    fragUV = world / patchLength;
+    vec4 position = vec4(world.x, 0.0, world.y, 1.0);
 
-    gl_Position = MVP * vec4(displacedPosition, 1.0);
+    // Displace based on the ocean map, choppy waves pull vertices towards the crests
+    vec4 displacement = textureLod(oceanMap, vec3(fragUV, 0.0), heightLod + morph);
+    float height = sign(displacement.y) * (1.0 - exp(-abs(displacement.y)));
+    vec4 displacedPosition = position;
+    displacedPosition.xz += displacement.xz * 0.4;
+    displacedPosition.y += height * 0.4;  
+    worldPosition = displacedPosition.xyz;
 
-    fragPosLightSpace = lightSpaceMatrix * vec4(worldPosition, 1.0);
+    gl_Position = (shadowPass != 0 ? lightSpaceMatrices[cascadeIndex] : viewProjection) * displacedPosition;
 }